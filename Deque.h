@@ -0,0 +1,169 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdexcept>
+#include <utility>
+
+// Double-ended queue made of fixed-size segments linked into a chain.
+// Growing never copies elements, so their addresses stay valid until they
+// are popped. The first segment is stored inline, the heap is only touched
+// once more than a segment worth of elements is held. Segment size is a power
+// of two, so positions wrap with a mask instead of a modulo.
+template <typename T, int SegmentBits = 8>
+class Deque {
+    private:
+        static const int kSegmentSize = 1 << SegmentBits;
+        static const int kMask = kSegmentSize - 1;
+        struct Segment {
+            T items[kSegmentSize];
+            Segment *prev;
+            Segment *next;
+        };
+        Segment inline_segment;
+        // One emptied segment is kept to avoid malloc churn at a boundary
+        Segment *spare;
+        Segment *head_segment;
+        Segment *tail_segment;
+        int head;
+        int tail;
+        int length;
+        Segment *acquire();
+        void release(Segment *segment);
+    public:
+        Deque();
+        ~Deque();
+        Deque(const Deque &source) = delete;
+        Deque(Deque &&source) = delete;
+        Deque& operator=(const Deque &source) = delete;
+        Deque& operator=(Deque &&source) = delete;
+        int len() const;
+        void push_back(T item);
+        void push_front(T item);
+        T pop_back();
+        T pop_front();
+        T& peek_back();
+        T& peek_front();
+};
+
+template <typename T, int SegmentBits>
+Deque<T, SegmentBits>::Deque() {
+    inline_segment.prev = NULL;
+    inline_segment.next = NULL;
+    spare = NULL;
+    head_segment = &inline_segment;
+    tail_segment = &inline_segment;
+    head = 0;
+    tail = 0;
+    length = 0;
+}
+
+template <typename T, int SegmentBits>
+Deque<T, SegmentBits>::~Deque() {
+    Segment *current = head_segment;
+    while (current) {
+        Segment *next = current->next;
+        if (current != &inline_segment) delete current;
+        current = next;
+    }
+    if (spare != &inline_segment) delete spare;
+}
+
+template <typename T, int SegmentBits>
+typename Deque<T, SegmentBits>::Segment *Deque<T, SegmentBits>::acquire() {
+    Segment *segment = spare;
+    if (segment) {
+        spare = NULL;
+    } else {
+        segment = new Segment;
+    }
+    segment->prev = NULL;
+    segment->next = NULL;
+    return segment;
+}
+
+template <typename T, int SegmentBits>
+void Deque<T, SegmentBits>::release(Segment *segment) {
+    if (!spare) {
+        spare = segment;
+        return;
+    }
+    if (segment == &inline_segment) std::swap(segment, spare);
+    delete segment;
+}
+
+template <typename T, int SegmentBits>
+int Deque<T, SegmentBits>::len() const {
+    return length;
+}
+
+// tail always points into an allocated segment, so a new one is linked as
+// soon as the current one fills up.
+template <typename T, int SegmentBits>
+void Deque<T, SegmentBits>::push_back(T item) {
+    tail_segment->items[tail] = item;
+    tail = (tail + 1) & kMask;
+    length++;
+    if (tail == 0) {
+        Segment *segment = acquire();
+        segment->prev = tail_segment;
+        tail_segment->next = segment;
+        tail_segment = segment;
+    }
+}
+
+template <typename T, int SegmentBits>
+void Deque<T, SegmentBits>::push_front(T item) {
+    head = (head - 1) & kMask;
+    if (head == kMask) {
+        Segment *segment = acquire();
+        segment->next = head_segment;
+        head_segment->prev = segment;
+        head_segment = segment;
+    }
+    head_segment->items[head] = item;
+    length++;
+}
+
+template <typename T, int SegmentBits>
+T Deque<T, SegmentBits>::pop_back() {
+    if (length == 0) throw std::logic_error("Trying to pop an empty deque.");
+    if (tail == 0) {
+        Segment *empty = tail_segment;
+        tail_segment = tail_segment->prev;
+        tail_segment->next = NULL;
+        release(empty);
+    }
+    tail = (tail - 1) & kMask;
+    length--;
+    return tail_segment->items[tail];
+}
+
+template <typename T, int SegmentBits>
+T Deque<T, SegmentBits>::pop_front() {
+    if (length == 0) throw std::logic_error("Trying to pop an empty deque.");
+    T item = head_segment->items[head];
+    head = (head + 1) & kMask;
+    length--;
+    if (head == 0) {
+        Segment *empty = head_segment;
+        head_segment = head_segment->next;
+        head_segment->prev = NULL;
+        release(empty);
+    }
+    return item;
+}
+
+template <typename T, int SegmentBits>
+T& Deque<T, SegmentBits>::peek_back() {
+    if (length == 0) throw std::logic_error("Trying to peek an empty deque.");
+    if (tail == 0) return tail_segment->prev->items[kMask];
+    return tail_segment->items[tail - 1];
+}
+
+template <typename T, int SegmentBits>
+T& Deque<T, SegmentBits>::peek_front() {
+    if (length == 0) throw std::logic_error("Trying to peek an empty deque.");
+    return head_segment->items[head];
+}
+
+#endif
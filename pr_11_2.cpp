@@ -9,63 +9,565 @@
 
 #include <iostream>
 #include <vector>
-#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
-struct node_with_count {
-    int node;
-    int count;
+// Counts grow exponentially with the distance, int overflowed long before
+// the graphs got large. Unsigned, so anything beyond 2^64 wraps modulo 2^64
+// instead of being undefined.
+typedef unsigned long long path_count;
+
+// Compressed sparse row adjacency: the neighbours of a node are
+// neighbours[offsets[node]] .. neighbours[offsets[node + 1] - 1].
+struct csr_graph {
+    std::vector<size_t> offsets;
+    std::vector<int> neighbours;
+
+    int n_nodes() const {
+        return (int)offsets.size() - 1;
+    }
+    const int *begin(int node) const {
+        return neighbours.data() + offsets[node];
+    }
+    const int *end(int node) const {
+        return neighbours.data() + offsets[node + 1];
+    }
+};
+
+// Two passes over the edge list: degrees give the row offsets, then both
+// ends of every edge are written into their rows in input order.
+csr_graph build_csr_graph(int n_nodes, const std::vector<int>& edge_ends) {
+    csr_graph graph;
+    graph.offsets.assign(n_nodes + 1, 0);
+    for (size_t i = 0; i < edge_ends.size(); i++) {
+        if ((edge_ends[i] < 0) | (edge_ends[i] >= n_nodes)) {
+            throw std::out_of_range("Edge end is not a node of the graph.");
+        }
+        graph.offsets[edge_ends[i] + 1]++;
+    }
+    for (int i = 0; i < n_nodes; i++) graph.offsets[i + 1] += graph.offsets[i];
+    graph.neighbours.resize(edge_ends.size());
+    std::vector<size_t> fill(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (size_t i = 0; i + 1 < edge_ends.size(); i += 2) {
+        graph.neighbours[fill[edge_ends[i]]++] = edge_ends[i + 1];
+        graph.neighbours[fill[edge_ends[i + 1]]++] = edge_ends[i];
+    }
+    return graph;
+}
+
+// Reads integers through a large fread buffer, formatted
+// std::cin input dominates the run time on big edge lists.
+struct int_reader {
+    FILE *file;
+    char buffer[1 << 16];
+    size_t size;
+    size_t pos;
+
+    int_reader(FILE *file_): file(file_), size(0), pos(0) {}
+
+    int next_char() {
+        if (pos == size) {
+            size = fread(buffer, 1, sizeof(buffer), file);
+            pos = 0;
+            if (size == 0) return EOF;
+        }
+        return buffer[pos++];
+    }
+
+    // The sign is kept, so negative node ids fail the range checks.
+    bool read(int& value) {
+        int c = next_char();
+        while ((c != EOF) && (c != '-') && ((c < '0') || (c > '9'))) {
+            c = next_char();
+        }
+        if (c == EOF) return false;
+        bool negative = c == '-';
+        if (negative) {
+            c = next_char();
+            if ((c < '0') || (c > '9')) {
+                throw std::runtime_error("Sign without a number.");
+            }
+        }
+        value = 0;
+        while ((c >= '0') && (c <= '9')) {
+            value = value*10 + (c - '0');
+            c = next_char();
+        }
+        if (negative) value = -value;
+        return true;
+    }
 };
 
-int count_shortest_paths(const std::vector<std::vector<int> >& adj_table,
+csr_graph read_graph(int_reader& input) {
+    int n_nodes = 0;
+    int n_edges = 0;
+    input.read(n_nodes);
+    input.read(n_edges);
+    if ((n_nodes < 0) | (n_edges < 0)) {
+        throw std::out_of_range("Negative node or edge count.");
+    }
+    std::vector<int> edge_ends(2*(size_t)n_edges);
+    for (size_t i = 0; i < edge_ends.size(); i++) {
+        if (!input.read(edge_ends[i])) {
+            throw std::runtime_error("Unexpected end of the edge list.");
+        }
+    }
+    return build_csr_graph(n_nodes, edge_ends);
+}
+
+// Switching thresholds of the direction-optimizing BFS (Beamer et al.):
+// go bottom-up once the frontier's edges exceed 1/alpha of the edges of
+// unreached nodes, back top-down once the frontier holds less than 1/beta
+// of the nodes.
+const int kBottomUpAlpha = 14;
+const int kTopDownBeta = 24;
+
+// Expands the frontier outwards. A neighbour seen for the first time joins
+// the next level, every neighbour on the next level adds the current count.
+void top_down_step(const csr_graph& graph, int level,
+    const std::vector<int>& front_nodes, std::vector<int>& dist,
+    std::vector<path_count>& n_shortest_paths, std::vector<int>& next_nodes) {
+    for (size_t i = 0; i < front_nodes.size(); i++) {
+        int current = front_nodes[i];
+        for (const int *next = graph.begin(current);
+            next != graph.end(current); next++) {
+            if (dist[*next] < 0) {
+                dist[*next] = level + 1;
+                next_nodes.push_back(*next);
+            }
+            if (dist[*next] == level + 1) {
+                n_shortest_paths[*next] += n_shortest_paths[current];
+            }
+        }
+    }
+}
+
+// Every unreached node looks for parents in the frontier bitmap. All of
+// them have to be summed for the count, so the scan does not stop at the
+// first parent as in plain reachability BFS.
+void bottom_up_step(const csr_graph& graph, int level,
+    const std::vector<uint64_t>& front_bitmap, std::vector<int>& dist,
+    std::vector<path_count>& n_shortest_paths, std::vector<int>& next_nodes) {
+    for (int current = 0; current < graph.n_nodes(); current++) {
+        if (dist[current] >= 0) continue;
+        path_count paths = 0;
+        bool reached = false;
+        for (const int *prev = graph.begin(current);
+            prev != graph.end(current); prev++) {
+            if ((front_bitmap[*prev >> 6] >> (*prev & 63)) & 1) {
+                paths += n_shortest_paths[*prev];
+                reached = true;
+            }
+        }
+        if (reached) {
+            dist[current] = level + 1;
+            n_shortest_paths[current] = paths;
+            next_nodes.push_back(current);
+        }
+    }
+}
+
+// Level-synchronous BFS. A node's count is final once the level before
+// it has been scanned, so counts are added in place while the next frontier
+// is collected. Stops after the level that reaches node_finish.
+path_count count_shortest_paths(const csr_graph& graph,
     int node_start, int node_finish) {
-    std::vector<int> n_shortest_paths(adj_table.size(), 0);
-    n_shortest_paths.at(node_start) = 1;
-    std::set<int> front_nodes;
-    front_nodes.insert(node_start);
-    std::vector<node_with_count> accumulator(0);
-    while ((n_shortest_paths.at(node_finish) == 0)
-        && (front_nodes.size() > 0)) {
-        for (std::set<int>::iterator it = front_nodes.begin();
-            it != front_nodes.end(); it++) {
-            int current = *it;
-            for (int i = 0; i < adj_table.at(current).size(); i++) {
-                int next = adj_table.at(current).at(i);
-                if (n_shortest_paths.at(next) == 0) {
-                    node_with_count next_with_count;
-                    next_with_count.node = next;
-                    next_with_count.count = n_shortest_paths.at(current);
-                    accumulator.push_back(next_with_count);
+    const int n_nodes = graph.n_nodes();
+    if ((node_start < 0) | (node_start >= n_nodes)
+        | (node_finish < 0) | (node_finish >= n_nodes)) {
+        throw std::out_of_range("Query node is not a node of the graph.");
+    }
+    std::vector<int> dist(n_nodes, -1);
+    std::vector<path_count> n_shortest_paths(n_nodes, 0);
+    std::vector<uint64_t> front_bitmap;
+    std::vector<int> front_nodes(1, node_start);
+    std::vector<int> next_nodes;
+    dist[node_start] = 0;
+    n_shortest_paths[node_start] = 1;
+    size_t unreached_edges = graph.neighbours.size();
+    bool bottom_up = false;
+    for (int level = 0; (dist[node_finish] < 0) & !front_nodes.empty();
+        level++) {
+        size_t front_edges = 0;
+        for (size_t i = 0; i < front_nodes.size(); i++) {
+            int current = front_nodes[i];
+            front_edges += graph.offsets[current + 1] - graph.offsets[current];
+        }
+        unreached_edges -= front_edges;
+        if (!bottom_up) {
+            bottom_up = front_edges > unreached_edges / kBottomUpAlpha;
+        } else {
+            bottom_up = front_nodes.size() >= (size_t)n_nodes / kTopDownBeta;
+        }
+        next_nodes.clear();
+        if (bottom_up) {
+            front_bitmap.assign((n_nodes + 63) / 64, 0);
+            for (size_t i = 0; i < front_nodes.size(); i++) {
+                front_bitmap[front_nodes[i] >> 6] |= 1ULL << (front_nodes[i] & 63);
+            }
+            bottom_up_step(graph, level, front_bitmap, dist, n_shortest_paths,
+                next_nodes);
+        } else {
+            top_down_step(graph, level, front_nodes, dist, n_shortest_paths,
+                next_nodes);
+        }
+        front_nodes.swap(next_nodes);
+    }
+    return n_shortest_paths[node_finish];
+}
+
+// Single-pair counting from both ends, a whole level of the smaller frontier
+// at a time. The first level that reaches nodes seen from the other end
+// lies at the same distance on every shortest path, each path crosses it
+// exactly once, so the answer is the sum of forward times backward counts
+// over that level.
+path_count count_shortest_paths_bidirectional(const csr_graph& graph,
+    int node_start, int node_finish) {
+    const int n_nodes = graph.n_nodes();
+    if ((node_start < 0) | (node_start >= n_nodes)
+        | (node_finish < 0) | (node_finish >= n_nodes)) {
+        throw std::out_of_range("Query node is not a node of the graph.");
+    }
+    if (node_start == node_finish) return 1;
+    const int ends[2] = {node_start, node_finish};
+    std::vector<int> dist[2];
+    std::vector<path_count> n_shortest_paths[2];
+    std::vector<int> front_nodes[2];
+    std::vector<int> next_nodes;
+    int level[2] = {0, 0};
+    for (int side = 0; side < 2; side++) {
+        dist[side].assign(n_nodes, -1);
+        n_shortest_paths[side].assign(n_nodes, 0);
+        front_nodes[side].assign(1, ends[side]);
+        dist[side][ends[side]] = 0;
+        n_shortest_paths[side][ends[side]] = 1;
+    }
+    while (!front_nodes[0].empty() & !front_nodes[1].empty()) {
+        const int side = front_nodes[0].size() <= front_nodes[1].size() ? 0 : 1;
+        const int other = 1 - side;
+        next_nodes.clear();
+        top_down_step(graph, level[side], front_nodes[side], dist[side],
+            n_shortest_paths[side], next_nodes);
+        level[side]++;
+        front_nodes[side].swap(next_nodes);
+        bool met = false;
+        path_count n_paths = 0;
+        for (size_t i = 0; i < front_nodes[side].size(); i++) {
+            int current = front_nodes[side][i];
+            if (dist[other][current] < 0) continue;
+            met = true;
+            n_paths += n_shortest_paths[side][current]
+                * n_shortest_paths[other][current];
+        }
+        if (met) return n_paths;
+    }
+    return 0;
+}
+
+// Frontier nodes taken at once by a thread, and the smallest frontier worth
+// starting threads for; smaller levels are expanded by the calling thread.
+const int kParallelChunk = 1 << 10;
+const size_t kParallelGrain = 1 << 14;
+
+// Level-synchronous top-down BFS with the frontier of each level split
+// between threads in chunks taken from an atomic cursor. A thread claims a
+// node for the next level by moving its distance from -1 with
+// compare-and-swap and adds counts with fetch_add; the claims go to its own
+// buffer, and the buffers are laid one after another into the next
+// frontier at offsets given by a prefix sum.
+struct parallel_bfs {
+    const csr_graph& graph;
+    std::vector<std::atomic<int> > dist;
+    std::vector<std::atomic<path_count> > n_shortest_paths;
+    std::vector<int> front_nodes;
+    std::vector<std::vector<int> > next_nodes;
+    std::atomic<size_t> cursor;
+    int level;
+
+    parallel_bfs(const csr_graph& graph_, int n_threads): graph(graph_),
+        dist(graph_.n_nodes()), n_shortest_paths(graph_.n_nodes()),
+        next_nodes(n_threads), cursor(0), level(0) {
+        for (int i = 0; i < graph.n_nodes(); i++) {
+            dist[i].store(-1, std::memory_order_relaxed);
+            n_shortest_paths[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void expand(int thread) {
+        std::vector<int>& claimed = next_nodes[thread];
+        for (size_t begin = cursor.fetch_add(kParallelChunk);
+            begin < front_nodes.size(); begin = cursor.fetch_add(kParallelChunk)) {
+            size_t end = std::min(begin + kParallelChunk, front_nodes.size());
+            for (size_t i = begin; i < end; i++) {
+                int current = front_nodes[i];
+                path_count paths =
+                    n_shortest_paths[current].load(std::memory_order_relaxed);
+                for (const int *next = graph.begin(current);
+                    next != graph.end(current); next++) {
+                    int next_dist = dist[*next].load(std::memory_order_relaxed);
+                    if (next_dist < 0) {
+                        if (dist[*next].compare_exchange_strong(next_dist,
+                            level + 1, std::memory_order_relaxed)) {
+                            claimed.push_back(*next);
+                            next_dist = level + 1;
+                        }
+                    }
+                    if (next_dist == level + 1) {
+                        n_shortest_paths[*next].fetch_add(paths,
+                            std::memory_order_relaxed);
+                    }
                 }
             }
         }
+    }
+
+    // Thread joins order one level's updates before the next level reads.
+    void step() {
+        const int n_threads = front_nodes.size() < kParallelGrain
+            ? 1 : (int)next_nodes.size();
+        cursor.store(0);
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < n_threads; i++) {
+            helpers.push_back(std::thread(&parallel_bfs::expand, this, i));
+        }
+        expand(0);
+        for (size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+        std::vector<size_t> offsets(n_threads + 1, 0);
+        for (int i = 0; i < n_threads; i++) {
+            offsets[i + 1] = offsets[i] + next_nodes[i].size();
+        }
+        front_nodes.resize(offsets[n_threads]);
+        for (int i = 0; i < n_threads; i++) {
+            std::copy(next_nodes[i].begin(), next_nodes[i].end(),
+                front_nodes.begin() + offsets[i]);
+            next_nodes[i].clear();
+        }
+        level++;
+    }
+};
+
+path_count count_shortest_paths_parallel(const csr_graph& graph,
+    int node_start, int node_finish, int n_threads) {
+    const int n_nodes = graph.n_nodes();
+    if ((node_start < 0) | (node_start >= n_nodes)
+        | (node_finish < 0) | (node_finish >= n_nodes)) {
+        throw std::out_of_range("Query node is not a node of the graph.");
+    }
+    if (n_threads <= 0) n_threads = std::thread::hardware_concurrency();
+    if (n_threads <= 0) n_threads = 1;
+    parallel_bfs search(graph, n_threads);
+    search.dist[node_start].store(0);
+    search.n_shortest_paths[node_start].store(1);
+    search.front_nodes.push_back(node_start);
+    while ((search.dist[node_finish].load() < 0)
+        & !search.front_nodes.empty()) {
+        search.step();
+    }
+    return search.n_shortest_paths[node_finish].load();
+}
+
+const int kLanes = 64;
+const size_t kBatchSize = 1 << 16;
+
+struct path_query {
+    int node_start;
+    int node_finish;
+    int lane;
+    path_count answer;
+};
+
+// Up to 64 breadth-first searches sharing every scan of the graph, one bit
+// lane per source in the seen and frontier masks of each node (MS-BFS).
+// Counts are laid out lane after lane, lane * n_nodes + node. Arrays are
+// zeroed once; a run visits only the frontier lists and clears the nodes
+// it reached afterwards. Finish nodes carry the lanes that wait for them,
+// so reaching one is noticed when its masks are merged and the stop test
+// costs nothing per level: a run costs the edges of its frontiers plus the
+// size of its group.
+struct multi_source_bfs {
+    const csr_graph& graph;
+    std::vector<uint64_t> seen;
+    std::vector<uint64_t> front;
+    std::vector<uint64_t> next;
+    std::vector<uint64_t> waiting;
+    std::vector<path_count> n_shortest_paths;
+    std::vector<int> front_nodes;
+    std::vector<int> next_nodes;
+    std::vector<int> reached_nodes;
+
+    multi_source_bfs(const csr_graph& graph_): graph(graph_),
+        seen(graph_.n_nodes()), front(graph_.n_nodes()),
+        next(graph_.n_nodes()), waiting(graph_.n_nodes()),
+        n_shortest_paths((size_t)kLanes*graph_.n_nodes()) {}
+
+    path_count& count(int lane, int node) {
+        return n_shortest_paths[(size_t)lane*graph.n_nodes() + node];
+    }
+
+    // Sources must be distinct. Searches until every query of the group has
+    // its finish reached or all frontiers die out.
+    void run(const std::vector<int>& sources, std::vector<path_query*>& group) {
         front_nodes.clear();
-        while (accumulator.size() > 0) {
-            node_with_count current = accumulator.back();
-            accumulator.pop_back();
-            front_nodes.insert(current.node);
-            n_shortest_paths.at(current.node) += current.count;
+        reached_nodes.clear();
+        // Distinct (finish, lane) pairs not reached yet
+        int n_waiting = 0;
+        for (size_t i = 0; i < group.size(); i++) {
+            uint64_t& lanes = waiting[group[i]->node_finish];
+            const uint64_t lane = 1ULL << group[i]->lane;
+            if (!(lanes & lane)) n_waiting++;
+            lanes |= lane;
+        }
+        for (size_t lane = 0; lane < sources.size(); lane++) {
+            const int source = sources[lane];
+            seen[source] |= 1ULL << lane;
+            front[source] |= 1ULL << lane;
+            count(lane, source) = 1;
+            front_nodes.push_back(source);
+            reached_nodes.push_back(source);
+            n_waiting -= (waiting[source] >> lane) & 1;
+        }
+        while ((n_waiting > 0) & !front_nodes.empty()) {
+            next_nodes.clear();
+            for (size_t i = 0; i < front_nodes.size(); i++) {
+                const int current = front_nodes[i];
+                const uint64_t lanes = front[current];
+                for (const int *neighbour = graph.begin(current);
+                    neighbour != graph.end(current); neighbour++) {
+                    uint64_t reached = lanes & ~seen[*neighbour];
+                    if (reached == 0) continue;
+                    if (next[*neighbour] == 0) next_nodes.push_back(*neighbour);
+                    next[*neighbour] |= reached;
+                    while (reached) {
+                        int lane = __builtin_ctzll(reached);
+                        reached &= reached - 1;
+                        count(lane, *neighbour) += count(lane, current);
+                    }
+                }
+            }
+            for (size_t i = 0; i < front_nodes.size(); i++) {
+                front[front_nodes[i]] = 0;
+            }
+            for (size_t i = 0; i < next_nodes.size(); i++) {
+                const int current = next_nodes[i];
+                n_waiting -= __builtin_popcountll(next[current] & waiting[current]);
+                seen[current] |= next[current];
+                front[current] = next[current];
+                next[current] = 0;
+            }
+            front_nodes.swap(next_nodes);
+            reached_nodes.insert(reached_nodes.end(), front_nodes.begin(),
+                front_nodes.end());
+        }
+        for (size_t i = 0; i < group.size(); i++) {
+            group[i]->answer = count(group[i]->lane, group[i]->node_finish);
+            waiting[group[i]->node_finish] = 0;
+        }
+        for (size_t i = 0; i < reached_nodes.size(); i++) {
+            const int current = reached_nodes[i];
+            for (uint64_t lanes = seen[current]; lanes; lanes &= lanes - 1) {
+                count(__builtin_ctzll(lanes), current) = 0;
+            }
+            seen[current] = 0;
+            front[current] = 0;
+        }
+    }
+};
+
+// Queries are grouped by source, 64 distinct sources per traversal.
+void count_shortest_paths_batch(multi_source_bfs& search,
+    std::vector<path_query>& queries) {
+    const int n_nodes = search.graph.n_nodes();
+    std::vector<path_query*> order(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        if ((queries[i].node_start < 0) | (queries[i].node_start >= n_nodes)
+            | (queries[i].node_finish < 0)
+            | (queries[i].node_finish >= n_nodes)) {
+            throw std::out_of_range("Query node is not a node of the graph.");
         }
+        order[i] = &queries[i];
+    }
+    std::sort(order.begin(), order.end(),
+        [](const path_query *left, const path_query *right) {
+            return left->node_start < right->node_start;
+        });
+    std::vector<int> sources;
+    std::vector<path_query*> group;
+    size_t i = 0;
+    while (i < order.size()) {
+        sources.clear();
+        group.clear();
+        while ((i < order.size()) & (sources.size() < (size_t)kLanes)) {
+            const int source = order[i]->node_start;
+            while ((i < order.size()) && (order[i]->node_start == source)) {
+                order[i]->lane = (int)sources.size();
+                group.push_back(order[i++]);
+            }
+            sources.push_back(source);
+        }
+        search.run(sources, group);
     }
-    return n_shortest_paths.at(node_finish);
 }
 
-int main() {
-    int n_nodes;
-    std::cin >> n_nodes;
-    int n_edges;
-    std::cin >> n_edges;
-    std::vector<std::vector<int> > adj_table(n_nodes, std::vector<int>());
-    for (int i = 0; i < n_edges; i++) {
-        int node_1, node_2;
-        std::cin >> node_1 >> node_2;
-        adj_table.at(node_1).push_back(node_2);
-        adj_table.at(node_2).push_back(node_1);
+// Pass --bidirectional to search from both query nodes at once, --batch to
+// answer every query pair up to the end of the input, one answer per line,
+// --threads N to spread one search over N threads (0 for all cores).
+int main(int argc, char **argv) {
+    bool bidirectional = false;
+    bool batch = false;
+    int n_threads = -1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bidirectional") == 0) bidirectional = true;
+        if (strcmp(argv[i], "--batch") == 0) batch = true;
+        if ((strcmp(argv[i], "--threads") == 0) & (i + 1 < argc)) {
+            n_threads = atoi(argv[++i]);
+        }
     }
 
-    int node_start, node_finish;
-    std::cin >> node_start >> node_finish;
+    int_reader input(stdin);
+    csr_graph graph = read_graph(input);
 
-    std::cout << count_shortest_paths(adj_table, node_start, node_finish);
+    if (batch) {
+        multi_source_bfs search(graph);
+        std::vector<path_query> queries;
+        path_query query;
+        bool more = true;
+        while (more) {
+            queries.clear();
+            while ((queries.size() < kBatchSize)
+                && input.read(query.node_start)
+                && input.read(query.node_finish)) {
+                queries.push_back(query);
+            }
+            if (queries.empty()) break;
+            more = queries.size() == kBatchSize;
+            count_shortest_paths_batch(search, queries);
+            for (size_t i = 0; i < queries.size(); i++) {
+                std::cout << queries[i].answer << '\n';
+            }
+        }
+        return 0;
+    }
+
+    int node_start = 0;
+    int node_finish = 0;
+    input.read(node_start);
+    input.read(node_finish);
+
+    if (n_threads >= 0) {
+        std::cout << count_shortest_paths_parallel(graph, node_start,
+            node_finish, n_threads);
+    } else if (bidirectional) {
+        std::cout << count_shortest_paths_bidirectional(graph, node_start,
+            node_finish);
+    } else {
+        std::cout << count_shortest_paths(graph, node_start, node_finish);
+    }
     std::cout << '\n';
 
     return 0;
@@ -18,181 +18,466 @@
 
 
 #include <iostream>
+#include <fstream>
 #include <set>
-#include <queue>
 #include <deque>
 #include <cstring>
+#include <climits>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 typedef unsigned char uc;
 typedef uint64_t st;
 
-struct Node {
-    st state;
+// Narrowest unsigned integer that holds a packed board of the given width.
+template <int Bits, bool Fits32 = (Bits <= 32), bool Fits64 = (Bits <= 64)>
+struct PackedState {
+    typedef unsigned __int128 type;
+};
+
+template <int Bits>
+struct PackedState<Bits, false, true> {
+    typedef uint64_t type;
+};
+
+template <int Bits>
+struct PackedState<Bits, true, true> {
+    typedef uint32_t type;
+};
+
+// Cell shifts and goal coordinates of every tile, filled in by the compiler.
+// The empty cell is headed for the bottom right corner.
+template <int Rows, int Cols>
+struct BoardTables {
+    static constexpr int kCells = Rows*Cols;
+    static constexpr int kBits = kCells <= 16 ? 4 : 5;
+    int shift[kCells];
+    int goal_row[kCells];
+    int goal_col[kCells];
+    int distance[kCells][kCells];
+
+    constexpr BoardTables(): shift(), goal_row(), goal_col(), distance() {
+        for (int cell = 0; cell < kCells; cell++) {
+            shift[cell] = (kCells - 1 - cell)*kBits;
+        }
+        for (int tile = 0; tile < kCells; tile++) {
+            int temp = (tile + kCells - 1) % kCells;
+            goal_row[tile] = temp / Cols;
+            goal_col[tile] = temp % Cols;
+            for (int cell = 0; cell < kCells; cell++) {
+                int rows = cell / Cols - goal_row[tile];
+                int cols = cell % Cols - goal_col[tile];
+                distance[tile][cell] = (rows < 0 ? -rows : rows)
+                    + (cols < 0 ? -cols : cols);
+            }
+        }
+    }
+};
+
+// Board of Rows x Cols cells packed row by row, first cell in the highest
+// bits. Sizes are template arguments, so every loop below has constant
+// bounds and there are no size checks at run time.
+template <int Rows, int Cols>
+struct PuzzleNode {
+    static constexpr int kRows = Rows;
+    static constexpr int kCols = Cols;
+    static constexpr int kCells = Rows*Cols;
+    static constexpr int kBits = BoardTables<Rows, Cols>::kBits;
+    static constexpr int kMask = (1 << kBits) - 1;
+    static constexpr int kMaxLine = Rows > Cols ? Rows : Cols;
+    static constexpr BoardTables<Rows, Cols> kTables =
+        BoardTables<Rows, Cols>();
+    typedef typename PackedState<kCells*kBits>::type State;
+
+    State state;
     uc empty_row;
     uc empty_col;
     int heuristic;
     mutable int dist;
     mutable char prev_move;
-    bool operator<(const Node& other) const {
+    bool operator<(const PuzzleNode& other) const {
         return state < other.state;
     }
-    static int Heuristic(const int mat[4][4]) {
+    // Manhattan distance of every cell including the empty one plus two per
+    // linear conflict, may overestimate.
+    static int Heuristic(State state_) {
+        int manhattan = 0;
+        for (int i = 0; i < Rows; i++) {
+            for (int j = 0; j < Cols; j++) {
+                manhattan += TileDistance(Tile(state_, i, j), i, j);
+            }
+        }
         int lin_conflicts = 0;
+        for (int i = 0; i < Rows; i++) lin_conflicts += RowConflicts(state_, i);
+        for (int i = 0; i < Cols; i++) lin_conflicts += ColConflicts(state_, i);
+        return manhattan + 2*lin_conflicts;
+    }
+    // Number of tiles that have to step out of the line so that the rest of
+    // them are in the right order: tiles minus the longest increasing run.
+    static int LineRemovals(const int *goal_positions, int n_tiles) {
+        int longest[kMaxLine];
+        int best = 0;
+        for (int i = 0; i < n_tiles; i++) {
+            longest[i] = 1;
+            for (int j = 0; j < i; j++) {
+                if ((goal_positions[j] < goal_positions[i])
+                    & (longest[j] + 1 > longest[i]))
+                    longest[i] = longest[j] + 1;
+            }
+            if (longest[i] > best) best = longest[i];
+        }
+        return n_tiles - best;
+    }
+    // Heuristic counts the empty cell and every conflicting pair, so it may
+    // overestimate. This variant skips the empty cell and charges two moves
+    // per tile that must leave its line, and never overestimates.
+    static int AdmissibleHeuristic(const int mat[Rows][Cols]) {
         int manhattan = 0;
-        int temp_mat[4][4];
-        std::memcpy(temp_mat, mat, 16*sizeof(int));
-        for (int i = 0; i < 4; i++) {
-            for (int j = 0; j < 4; j++) {
-                int temp = (mat[i][j] + 15) % 16;
-                manhattan += abs(i - (temp / 4));
-                manhattan += abs(j - (temp % 4));
-                if ((i - temp / 4 != 0) | (temp == 15)) {
-                    temp_mat[i][j] = 4;
-                } else {
-                    temp_mat[i][j] = temp % 4;
+        int removals = 0;
+        for (int i = 0; i < Rows; i++) {
+            int row_goals[Cols];
+            int n_row = 0;
+            for (int j = 0; j < Cols; j++) {
+                int tile = mat[i][j];
+                if (tile == 0) continue;
+                manhattan += TileDistance(tile, i, j);
+                if (kTables.goal_row[tile] == i) {
+                    row_goals[n_row++] = kTables.goal_col[tile];
                 }
             }
-            for (int j = 0; j < 4; j++) {
-                for (int k = j + 1; k < 4; k++) {
-                    if ((temp_mat[i][j] < 4)
-                        & (temp_mat[i][j] >= temp_mat[i][k]))
-                        lin_conflicts++;
+            removals += LineRemovals(row_goals, n_row);
+        }
+        for (int j = 0; j < Cols; j++) {
+            int col_goals[Rows];
+            int n_col = 0;
+            for (int i = 0; i < Rows; i++) {
+                int tile = mat[i][j];
+                if ((tile != 0) && (kTables.goal_col[tile] == j)) {
+                    col_goals[n_col++] = kTables.goal_row[tile];
                 }
             }
+            removals += LineRemovals(col_goals, n_col);
         }
-        for (int i = 0; i < 4; i++) {
-            for (int j = 0; j < 4; j++) {
-                int temp = (mat[j][i] + 15) % 16;
-                if ((i - temp % 4 != 0) | (temp == 15)) {
-                    temp_mat[j][i] = 4;
-                } else {
-                    temp_mat[j][i] = temp / 4;
-                }
+        return manhattan + 2*removals;
+    }
+    static int Tile(State state_, int row, int col) {
+        return (int)((state_ >> kTables.shift[row*Cols + col]) & kMask);
+    }
+    static int TileDistance(int tile, int row, int col) {
+        return kTables.distance[tile][row*Cols + col];
+    }
+    static int RowConflicts(State state_, int row) {
+        int goals[Cols];
+        for (int j = 0; j < Cols; j++) {
+            int tile = Tile(state_, row, j);
+            goals[j] = ((tile == 0) | (kTables.goal_row[tile] != row))
+                ? Cols : kTables.goal_col[tile];
+        }
+        int lin_conflicts = 0;
+        for (int j = 0; j < Cols; j++) {
+            for (int k = j + 1; k < Cols; k++) {
+                if ((goals[j] < Cols) & (goals[j] >= goals[k])) lin_conflicts++;
             }
-            for (int j = 0; j < 4; j++) {
-                for (int k = j + 1; k < 4; k++) {
-                    if ((temp_mat[j][i] < 4)
-                        & (temp_mat[j][i] >= temp_mat[k][i]))
-                        lin_conflicts++;
-                }
+        }
+        return lin_conflicts;
+    }
+    static int ColConflicts(State state_, int col) {
+        int goals[Rows];
+        for (int j = 0; j < Rows; j++) {
+            int tile = Tile(state_, j, col);
+            goals[j] = ((tile == 0) | (kTables.goal_col[tile] != col))
+                ? Rows : kTables.goal_row[tile];
+        }
+        int lin_conflicts = 0;
+        for (int j = 0; j < Rows; j++) {
+            for (int k = j + 1; k < Rows; k++) {
+                if ((goals[j] < Rows) & (goals[j] >= goals[k])) lin_conflicts++;
             }
         }
-        return manhattan + 2*lin_conflicts;
+        return lin_conflicts;
     }
-    static int Heuristic(st state_) {
-        int mat[4][4];
-        for (int i = 3; i >= 0; i--) {
-            for (int j = 3; j >= 0; j--) {
-                mat[i][j] = (state_ % 16);
-                state_ = state_ >> 4;
+    static PuzzleNode FromState(State state_) {
+        PuzzleNode node;
+        node.state = state_;
+        node.prev_move = 4;
+        node.dist = 0;
+        node.heuristic = Heuristic(state_);
+        for (int i = 0; i < Rows; i++) {
+            for (int j = 0; j < Cols; j++) {
+                if (Tile(state_, i, j) == 0) {
+                    node.empty_row = i;
+                    node.empty_col = j;
+                }
             }
         }
-        return Heuristic(mat);
+        return node;
     }
-    Node SpawnChild(uc move) const {
-        Node new_node;
+    // Only one tile moves, so the cells are swapped in place and the
+    // heuristic is updated from the two cells and two lines that changed.
+    // Sliding past the empty cell keeps the order of tiles along the move.
+    PuzzleNode SpawnChild(uc move) const {
+        PuzzleNode new_node;
         new_node.empty_row = move % 2 == 0 ? empty_row + 1 - move : empty_row;
         new_node.empty_col = move % 2 == 1 ? empty_col - 2 + move : empty_col;
-        if ((new_node.empty_row > 3) | (new_node.empty_row < 0) |
-            (new_node.empty_col > 3) | (new_node.empty_col < 0)) {
+        if ((new_node.empty_row >= Rows) | (new_node.empty_col >= Cols)) {
                 new_node.heuristic = -1;
                 return new_node;
         }
-        int mat[4][4];
-        st temp = state;
-        for (int i = 3; i >= 0; i--) {
-            for (int j = 3; j >= 0; j--) {
-                mat[i][j] = temp % 16;
-                temp = temp >> 4;
-            }
+        const int old_shift = kTables.shift[empty_row*Cols + empty_col];
+        const int new_shift =
+            kTables.shift[new_node.empty_row*Cols + new_node.empty_col];
+        const State tile = (state >> new_shift) & kMask;
+        new_node.state = (state & ~((State)kMask << new_shift))
+            | (tile << old_shift);
+        int delta = TileDistance(tile, empty_row, empty_col)
+            - TileDistance(tile, new_node.empty_row, new_node.empty_col)
+            + TileDistance(0, new_node.empty_row, new_node.empty_col)
+            - TileDistance(0, empty_row, empty_col);
+        if (move % 2 == 0) {
+            delta += 2*(RowConflicts(new_node.state, empty_row)
+                + RowConflicts(new_node.state, new_node.empty_row)
+                - RowConflicts(state, empty_row)
+                - RowConflicts(state, new_node.empty_row));
+        } else {
+            delta += 2*(ColConflicts(new_node.state, empty_col)
+                + ColConflicts(new_node.state, new_node.empty_col)
+                - ColConflicts(state, empty_col)
+                - ColConflicts(state, new_node.empty_col));
         }
-        mat[empty_row][empty_col] = mat[new_node.empty_row][new_node.empty_col];
-        mat[new_node.empty_row][new_node.empty_col] = 0;
         new_node.dist = dist + 1;
         new_node.prev_move = move;
-        new_node.heuristic = Heuristic(mat);
-        new_node.state = 0;
-        for (int i = 0; i < 4; i++) {
-            for (int j = 0; j < 4; j++) {
-                new_node.state = new_node.state << 4;
-                new_node.state = new_node.state | mat[i][j];
-            }
-        }
+        new_node.heuristic = heuristic + delta;
         return new_node;
     }
 };
 
-struct weight_and_node {
-    int weight;
-    Node node;
-    weight_and_node(int weight_, Node node_): weight(weight_), node(node_) {}
-    bool operator<(const weight_and_node& other) const {
-        return weight > other.weight;
-    }
+template <int Rows, int Cols>
+constexpr BoardTables<Rows, Cols> PuzzleNode<Rows, Cols>::kTables;
+
+inline size_t hash_state(uint64_t state) {
+    state ^= state >> 33;
+    state *= 0xff51afd7ed558ccdULL;
+    state ^= state >> 33;
+    state *= 0xc4ceb9fe1a85ec53ULL;
+    state ^= state >> 33;
+    return (size_t)state;
+}
+
+inline size_t hash_state(uint32_t state) {
+    return hash_state((uint64_t)state);
+}
+
+inline size_t hash_state(unsigned __int128 state) {
+    return hash_state((uint64_t)state ^ hash_state((uint64_t)(state >> 64)));
+}
+
+template <typename NodeT>
+struct PuzzleVisitedEntry {
+    typename NodeT::State state;
+    int dist;
+    char prev_move;
+    // Anytime search round that expanded the state
+    uc round;
 };
 
-struct Visited {
-    std::set<Node> pool;
-    bool Insert(Node new_node) {
-        std::set<Node>::iterator it = pool.find(new_node);
-        if (it == pool.end()) {
-            pool.insert(new_node);
-            return true;
-        } else {
-            if (new_node.dist < it->dist) {
-                it->dist = new_node.dist;
-                it->prev_move = new_node.prev_move;
-            }
-            return false;
+// Open addressing with linear probing over a power of two table. Tiles are
+// distinct, so no valid state packs to zero and zero marks a free slot.
+template <typename NodeT>
+struct PuzzleVisited {
+    typedef typename NodeT::State State;
+    typedef PuzzleVisitedEntry<NodeT> Entry;
+    std::vector<Entry> pool;
+    size_t n_entries;
+
+    PuzzleVisited(): pool(1 << 10), n_entries(0) {
+        Clear();
+    }
+
+    // Empties the table but keeps its memory for the next search.
+    void Clear() {
+        for (size_t i = 0; i < pool.size(); i++) pool[i].state = 0;
+        n_entries = 0;
+    }
+
+    static size_t Hash(State state) {
+        return hash_state(state);
+    }
+
+    // The table never shrinks, so this is also the peak.
+    size_t Bytes() const {
+        return pool.capacity()*sizeof(Entry);
+    }
+
+    size_t Slot(State state) const {
+        const size_t mask = pool.size() - 1;
+        size_t slot = Hash(state) & mask;
+        while ((pool[slot].state != 0) & (pool[slot].state != state)) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void Rehash() {
+        std::vector<Entry> old_pool(pool.size() << 1);
+        old_pool.swap(pool);
+        for (size_t i = 0; i < pool.size(); i++) pool[i].state = 0;
+        for (size_t i = 0; i < old_pool.size(); i++) {
+            if (old_pool[i].state != 0) pool[Slot(old_pool[i].state)] = old_pool[i];
         }
     }
-};
 
-struct Front {
-    std::priority_queue<weight_and_node> pool;
+    const Entry *Find(State state) const {
+        const Entry &entry = pool[Slot(state)];
+        return entry.state == state ? &entry : NULL;
+    }
 
-    Node Pop() {
-        Node first = (pool.top()).node;
-        pool.pop();
-        return first;
+    // Entry of the node's state, filled from the node if it was missing.
+    // Valid until the next call.
+    Entry &Get(const NodeT &node, bool &added) {
+        if (2*(n_entries + 1) > pool.size()) Rehash();
+        Entry &entry = pool[Slot(node.state)];
+        added = entry.state == 0;
+        if (added) {
+            entry.state = node.state;
+            entry.dist = node.dist;
+            entry.prev_move = node.prev_move;
+            entry.round = 0;
+            n_entries++;
+        }
+        return entry;
     }
 
-    void Insert(Node new_node, int weight) {
-        pool.push(weight_and_node(weight, new_node));
+    // Single probe sequence for both the lookup and the insertion.
+    bool Insert(const NodeT &new_node) {
+        bool added;
+        Entry &entry = Get(new_node, added);
+        if (added) return true;
+        if (new_node.dist < entry.dist) {
+            entry.dist = new_node.dist;
+            entry.prev_move = new_node.prev_move;
+        }
+        return false;
     }
 };
 
-std::deque<uc> solve_fifteen(st start) {
-    Node start_node;
-    start_node.state = start;
-    start_node.prev_move = 4;
-    start_node.dist = 0;
-    start_node.heuristic = Node::Heuristic(start);
-    for (int i = 3; i >= 0; i--) {
-        for (int j = 3; j >= 0; j--) {
-            int temp = start % 16;
-            if (temp == 0)  {
-                start_node.empty_row = i;
-                start_node.empty_col = j;
-            }
-            start = start >> 4;
+// Node packed for the open list, 16 bytes for the 4x4 board.
+template <typename State>
+struct PuzzleFrontEntry {
+    State state;
+    unsigned short dist;
+    unsigned short heuristic;
+    uc empty;
+    uc prev_move;
+};
+
+// Weights are small non-negative integers, so the open list is an array of
+// buckets indexed by weight; the newest node of the lightest bucket goes
+// first. Weights below the current minimum are rare and just move it back.
+template <typename NodeT>
+struct PuzzleFront {
+    typedef PuzzleFrontEntry<typename NodeT::State> Entry;
+    std::vector<std::vector<Entry> > pool;
+    size_t min_weight;
+
+    PuzzleFront(): min_weight(0) {}
+
+    void Clear() {
+        for (size_t i = 0; i < pool.size(); i++) pool[i].clear();
+        min_weight = 0;
+    }
+
+    static Entry Pack(const NodeT &node) {
+        Entry entry;
+        entry.state = node.state;
+        entry.dist = node.dist;
+        entry.heuristic = node.heuristic;
+        entry.empty = node.empty_row*NodeT::kCols + node.empty_col;
+        entry.prev_move = node.prev_move;
+        return entry;
+    }
+
+    static NodeT Unpack(const Entry &entry) {
+        NodeT node;
+        node.state = entry.state;
+        node.dist = entry.dist;
+        node.heuristic = entry.heuristic;
+        node.empty_row = entry.empty / NodeT::kCols;
+        node.empty_col = entry.empty % NodeT::kCols;
+        node.prev_move = entry.prev_move;
+        return node;
+    }
+
+    // Buckets keep their capacity, so this is also the peak.
+    size_t Bytes() const {
+        size_t bytes = pool.capacity()*sizeof(std::vector<Entry>);
+        for (size_t i = 0; i < pool.size(); i++) {
+            bytes += pool[i].capacity()*sizeof(Entry);
+        }
+        return bytes;
+    }
+
+    bool Empty() {
+        while ((min_weight < pool.size()) && pool[min_weight].empty()) {
+            min_weight++;
         }
+        return min_weight == pool.size();
     }
-    Visited visited_pool;
-    Front front_pool;
+
+    NodeT Pop() {
+        while (pool[min_weight].empty()) min_weight++;
+        Entry entry = pool[min_weight].back();
+        pool[min_weight].pop_back();
+        return Unpack(entry);
+    }
+
+    void Insert(NodeT new_node, int weight) {
+        if (weight >= (int)pool.size()) pool.resize(weight + 1);
+        pool[weight].push_back(Pack(new_node));
+        if ((size_t)weight < min_weight) min_weight = weight;
+    }
+};
+
+// Closed and open lists of the weighted A*, reusable between solves.
+template <typename NodeT>
+struct PuzzleSearchSpace {
+    PuzzleVisited<NodeT> visited_pool;
+    PuzzleFront<NodeT> front_pool;
+};
+
+template <typename NodeT>
+std::deque<uc> solve_puzzle(typename NodeT::State start,
+    PuzzleSearchSpace<NodeT> &space, long long *expanded = NULL) {
+    NodeT start_node = NodeT::FromState(start);
+    PuzzleVisited<NodeT> &visited_pool = space.visited_pool;
+    PuzzleFront<NodeT> &front_pool = space.front_pool;
+    visited_pool.Clear();
+    front_pool.Clear();
+    long long n_expanded = 0;
     front_pool.Insert(start_node, start_node.heuristic);
-    Node last_node;
+    NodeT last_node;
     bool found_finish = false;
     if (start_node.heuristic == 0) {
         last_node = start_node;
         found_finish = true;
     }
     while (!found_finish) {
-        Node considered = front_pool.Pop();
+        NodeT considered = front_pool.Pop();
         if (!visited_pool.Insert(considered)) continue;
+        n_expanded++;
         for (int i = 0; i < 4; i++) {
             if ( (i + 2) % 4 == considered.prev_move) continue;
-            Node new_node = considered.SpawnChild(i);
+            NodeT new_node = considered.SpawnChild(i);
             if (new_node.heuristic < 0) continue;
             if (new_node.heuristic == 0) {
                 last_node = new_node;
@@ -207,11 +492,577 @@ std::deque<uc> solve_fifteen(st start) {
         uc move = last_node.prev_move;
         moves.push_front(move);
         last_node = last_node.SpawnChild((move + 2) % 4);
-        last_node = *visited_pool.pool.find(last_node);
+        last_node.prev_move = visited_pool.Find(last_node.state)->prev_move;
+    }
+    if (expanded) *expanded = n_expanded;
+    return moves;
+}
+
+// Anytime repairing A*: the weight on the heuristic goes from 2 down to 1 in
+// quarter steps. States improved after their expansion in a round wait in
+// incons and rejoin the open list, rekeyed with the next weight, so each
+// round goes on from the previous one instead of starting over. Once some
+// solution is known the search stops at the deadline and returns the best.
+template <typename NodeT>
+std::deque<uc> solve_puzzle_anytime(typename NodeT::State start,
+    PuzzleSearchSpace<NodeT> &space, int milliseconds,
+    long long *expanded = NULL) {
+    typedef typename PuzzleFront<NodeT>::Entry FrontEntryT;
+    typedef typename PuzzleVisited<NodeT>::Entry VisitedEntryT;
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(milliseconds);
+    typename NodeT::State goal = 0;
+    for (int i = 1; i <= NodeT::kCells; i++) {
+        goal = (goal << NodeT::kBits) | (typename NodeT::State)(i % NodeT::kCells);
+    }
+    NodeT start_node = NodeT::FromState(start);
+    PuzzleVisited<NodeT> &visited_pool = space.visited_pool;
+    PuzzleFront<NodeT> &front_pool = space.front_pool;
+    visited_pool.Clear();
+    front_pool.Clear();
+    std::vector<FrontEntryT> incons;
+    long long n_expanded = 0;
+    bool added;
+    visited_pool.Get(start_node, added);
+    front_pool.Insert(start_node, 0);
+    int goal_dist = start == goal ? 0 : INT_MAX;
+    int best_dist = INT_MAX;
+    std::deque<uc> best;
+    bool out_of_time = false;
+    for (int weight = 8; (weight >= 4) & !out_of_time; weight--) {
+        const uc round = 9 - weight;
+        std::vector<FrontEntryT> pending;
+        pending.swap(incons);
+        for (size_t i = 0; i < front_pool.pool.size(); i++) {
+            pending.insert(pending.end(), front_pool.pool[i].begin(),
+                front_pool.pool[i].end());
+        }
+        front_pool.Clear();
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (visited_pool.Find(pending[i].state)->dist != pending[i].dist) {
+                continue;
+            }
+            front_pool.Insert(PuzzleFront<NodeT>::Unpack(pending[i]),
+                weight*pending[i].heuristic + 4*pending[i].dist);
+        }
+        while (!front_pool.Empty()
+            && front_pool.min_weight < 4*(size_t)goal_dist) {
+            NodeT considered = front_pool.Pop();
+            VisitedEntryT &entry = visited_pool.Get(considered, added);
+            if ((entry.dist != considered.dist) | (entry.round == round)) {
+                continue;
+            }
+            entry.round = round;
+            n_expanded++;
+            if (((n_expanded & 1023) == 0) & (goal_dist < INT_MAX)
+                && std::chrono::steady_clock::now() > deadline) {
+                out_of_time = true;
+                break;
+            }
+            for (int i = 0; i < 4; i++) {
+                if ( (i + 2) % 4 == considered.prev_move) continue;
+                NodeT new_node = considered.SpawnChild(i);
+                if (new_node.heuristic < 0) continue;
+                VisitedEntryT &child = visited_pool.Get(new_node, added);
+                if (!added && child.dist <= new_node.dist) continue;
+                child.dist = new_node.dist;
+                child.prev_move = new_node.prev_move;
+                if (new_node.state == goal) {
+                    goal_dist = new_node.dist;
+                } else if (child.round == round) {
+                    incons.push_back(PuzzleFront<NodeT>::Pack(new_node));
+                } else {
+                    front_pool.Insert(new_node,
+                        weight*new_node.heuristic + 4*new_node.dist);
+                }
+            }
+        }
+        if (goal_dist < best_dist) {
+            best_dist = goal_dist;
+            best.clear();
+            NodeT last_node = NodeT::FromState(goal);
+            last_node.prev_move = visited_pool.Find(goal)->prev_move;
+            while (last_node.prev_move < 4) {
+                uc move = last_node.prev_move;
+                best.push_front(move);
+                last_node = last_node.SpawnChild((move + 2) % 4);
+                last_node.prev_move =
+                    visited_pool.Find(last_node.state)->prev_move;
+            }
+        }
+    }
+    if (expanded) *expanded = n_expanded;
+    return best;
+}
+
+typedef PuzzleNode<4, 4> Node;
+typedef PuzzleVisited<Node> Visited;
+typedef PuzzleFront<Node> Front;
+typedef Front::Entry FrontEntry;
+typedef PuzzleSearchSpace<Node> SearchSpace;
+
+std::deque<uc> solve_fifteen(st start, SearchSpace &space,
+    long long *expanded = NULL) {
+    return solve_puzzle<Node>(start, space, expanded);
+}
+
+std::deque<uc> solve_fifteen(st start) {
+    SearchSpace space;
+    return solve_fifteen(start, space);
+}
+
+// Hash distributed A*: every state belongs to the thread picked by the high
+// bits of its hash, only the owner keeps it in its open list and visited
+// table. Children owned by other threads are sent to them in parcels.
+const int kParcelSize = 64;
+const int kFlushInterval = 64;
+
+struct Parcel {
+    FrontEntry items[kParcelSize];
+    int n_items;
+    Parcel *next;
+};
+
+// Lock-free stack, any thread pushes and the owner takes everything at once,
+// so there is no single pop to suffer from ABA.
+struct Inbox {
+    std::atomic<Parcel*> head;
+
+    Inbox(): head(NULL) {}
+
+    void Push(Parcel *parcel) {
+        Parcel *old_head = head.load(std::memory_order_relaxed);
+        do {
+            parcel->next = old_head;
+        } while (!head.compare_exchange_weak(old_head, parcel,
+            std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    Parcel *TakeAll() {
+        return head.exchange(NULL, std::memory_order_acquire);
+    }
+};
+
+struct HdaSearch {
+    static const unsigned long long kBusyThread = 1ULL << 32;
+    int n_threads;
+    std::vector<SearchSpace> spaces;
+    std::vector<Inbox> inboxes;
+    // Per thread: parcels being filled for every other owner and emptied
+    // parcels ready for reuse.
+    std::vector<std::vector<Parcel*> > outgoing;
+    std::vector<std::vector<Parcel*> > spare;
+    std::vector<long long> expanded;
+    // Busy threads in the high half, parcels in flight in the low half. A
+    // thread only goes idle with nothing left to send, so once this drops
+    // to zero no work is left anywhere.
+    std::atomic<unsigned long long> work;
+    std::atomic<bool> found;
+    Node last_node;
+
+    HdaSearch(int n_threads_): n_threads(n_threads_), spaces(n_threads_),
+        inboxes(n_threads_), outgoing(n_threads_),
+        spare(n_threads_), expanded(n_threads_, 0),
+        work(n_threads_ * kBusyThread), found(false) {
+        for (int i = 0; i < n_threads; i++) {
+            outgoing[i].assign(n_threads, NULL);
+        }
+    }
+
+    ~HdaSearch() {
+        for (int i = 0; i < n_threads; i++) {
+            for (int j = 0; j < n_threads; j++) delete outgoing[i][j];
+            for (size_t j = 0; j < spare[i].size(); j++) delete spare[i][j];
+            Parcel *parcel = inboxes[i].TakeAll();
+            while (parcel) {
+                Parcel *next = parcel->next;
+                delete parcel;
+                parcel = next;
+            }
+        }
+    }
+
+    // The low bits of the hash pick the slot inside the owner's table.
+    int Owner(st state) const {
+        return (int)((((uint64_t)Visited::Hash(state) >> 32) * n_threads) >> 32);
+    }
+
+    void Post(int id, int owner) {
+        work.fetch_add(1);
+        inboxes[owner].Push(outgoing[id][owner]);
+        outgoing[id][owner] = NULL;
+    }
+
+    void Send(int id, const Node &new_node) {
+        int owner = Owner(new_node.state);
+        Parcel *&parcel = outgoing[id][owner];
+        if (!parcel) {
+            if (spare[id].empty()) {
+                parcel = new Parcel;
+            } else {
+                parcel = spare[id].back();
+                spare[id].pop_back();
+            }
+            parcel->n_items = 0;
+        }
+        parcel->items[parcel->n_items++] = Front::Pack(new_node);
+        if (parcel->n_items == kParcelSize) Post(id, owner);
+    }
+
+    void Flush(int id) {
+        for (int i = 0; i < n_threads; i++) {
+            if (outgoing[id][i]) Post(id, i);
+        }
+    }
+
+    void Work(int id) {
+        Visited &visited_pool = spaces[id].visited_pool;
+        Front &front_pool = spaces[id].front_pool;
+        bool busy = true;
+        int since_flush = 0;
+        while (!found.load(std::memory_order_relaxed)) {
+            Parcel *parcel = inboxes[id].TakeAll();
+            if (parcel) {
+                if (!busy) {
+                    work.fetch_add(kBusyThread);
+                    busy = true;
+                }
+                unsigned long long n_parcels = 0;
+                while (parcel) {
+                    for (int i = 0; i < parcel->n_items; i++) {
+                        Node new_node = Front::Unpack(parcel->items[i]);
+                        front_pool.Insert(new_node,
+                            2*new_node.heuristic + new_node.dist);
+                    }
+                    spare[id].push_back(parcel);
+                    parcel = parcel->next;
+                    n_parcels++;
+                }
+                work.fetch_sub(n_parcels);
+            }
+            if (front_pool.Empty()) {
+                if (busy) {
+                    Flush(id);
+                    busy = false;
+                    if (work.fetch_sub(kBusyThread) == kBusyThread) break;
+                } else if (work.load() == 0) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            Node considered = front_pool.Pop();
+            if (!visited_pool.Insert(considered)) continue;
+            expanded[id]++;
+            for (int i = 0; i < 4; i++) {
+                if ( (i + 2) % 4 == considered.prev_move) continue;
+                Node new_node = considered.SpawnChild(i);
+                if (new_node.heuristic < 0) continue;
+                if (new_node.heuristic == 0) {
+                    if (!found.exchange(true)) last_node = new_node;
+                    break;
+                }
+                if (Owner(new_node.state) == id) {
+                    front_pool.Insert(new_node,
+                        2*new_node.heuristic + new_node.dist);
+                } else {
+                    Send(id, new_node);
+                }
+            }
+            if (++since_flush == kFlushInterval) {
+                since_flush = 0;
+                Flush(id);
+            }
+        }
+    }
+};
+
+// Same weighted A* as solve_fifteen spread over n_threads threads; the
+// first thread to reach the goal wins, so the solution may differ.
+std::deque<uc> solve_fifteen_hda(st start, int n_threads,
+    long long *expanded = NULL, size_t *visited_bytes = NULL,
+    size_t *front_bytes = NULL) {
+    if (n_threads <= 0) n_threads = std::thread::hardware_concurrency();
+    if (n_threads <= 0) n_threads = 1;
+    Node start_node = Node::FromState(start);
+    std::deque<uc> moves;
+    if (expanded) *expanded = 0;
+    if (start_node.heuristic == 0) return moves;
+    HdaSearch search(n_threads);
+    search.spaces[search.Owner(start)].front_pool.Insert(start_node,
+        start_node.heuristic);
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < n_threads; i++) {
+        helpers.push_back(std::thread(&HdaSearch::Work, &search, i));
+    }
+    search.Work(0);
+    for (size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+    if (!search.found) return moves;
+    Node last_node = search.last_node;
+    while (last_node.prev_move < 4) {
+        uc move = last_node.prev_move;
+        moves.push_front(move);
+        last_node = last_node.SpawnChild((move + 2) % 4);
+        const Visited &visited_pool =
+            search.spaces[search.Owner(last_node.state)].visited_pool;
+        last_node.prev_move = visited_pool.Find(last_node.state)->prev_move;
+    }
+    for (int i = 0; i < n_threads; i++) {
+        if (expanded) *expanded += search.expanded[i];
+        if (visited_bytes) *visited_bytes += search.spaces[i].visited_pool.Bytes();
+        if (front_bytes) *front_bytes += search.spaces[i].front_pool.Bytes();
     }
     return moves;
 }
 
+// Additive pattern databases, 6-6-3 split. Each table holds, for every
+// placement of its tiles, the number of moves of those tiles needed to put
+// them in place; moves of other tiles are free, so the sums stay admissible.
+const int kPatternCount = 3;
+const int kPatternSizes[kPatternCount] = {6, 6, 3};
+const int kPatterns[kPatternCount][6] = {
+    {1, 5, 6, 9, 10, 13}, {7, 8, 11, 12, 14, 15}, {2, 3, 4}};
+
+// Number of ways to place k distinct tiles on 16 cells.
+inline uint32_t placements(int k) {
+    uint32_t count = 1;
+    for (int i = 0; i < k; i++) count *= 16 - i;
+    return count;
+}
+
+// Index of k distinct cells among all placements.
+inline uint32_t rank_cells(const uc *cells, int k) {
+    uint32_t rank = 0;
+    unsigned used = 0;
+    for (int i = 0; i < k; i++) {
+        unsigned below = used & ((1u << cells[i]) - 1);
+        rank = rank*(16 - i) + cells[i] - __builtin_popcount(below);
+        used |= 1u << cells[i];
+    }
+    return rank;
+}
+
+inline void unrank_cells(uint32_t rank, int k, uc *cells) {
+    int digits[16];
+    for (int i = k - 1; i >= 0; i--) {
+        digits[i] = rank % (16 - i);
+        rank /= 16 - i;
+    }
+    unsigned free_cells = 0xFFFF;
+    for (int i = 0; i < k; i++) {
+        unsigned left = free_cells;
+        for (int j = 0; j < digits[i]; j++) left &= left - 1;
+        cells[i] = __builtin_ctz(left);
+        free_cells &= ~(1u << cells[i]);
+    }
+}
+
+// Retrograde breadth-first search from the goal over placements of the
+// pattern tiles plus the empty cell. Moving a pattern tile costs one, any
+// other tile zero. The table keeps the minimum over empty cell positions.
+std::vector<uc> generate_pattern_table(int pattern) {
+    const int k = kPatternSizes[pattern];
+    std::vector<uc> dist(placements(k + 1), 0xFF);
+    uc cells[7];
+    for (int i = 0; i < k; i++) cells[i] = kPatterns[pattern][i] - 1;
+    cells[k] = 15;
+    uint32_t start = rank_cells(cells, k + 1);
+    dist[start] = 0;
+    std::vector<uint32_t> current(1, start);
+    std::vector<uint32_t> next;
+    for (int d = 0; !current.empty(); d++) {
+        while (!current.empty()) {
+            uint32_t state = current.back();
+            current.pop_back();
+            if (dist[state] != d) continue;
+            unrank_cells(state, k + 1, cells);
+            const uc empty = cells[k];
+            for (uc move = 0; move < 4; move++) {
+                uc row = move % 2 == 0 ? empty / 4 + 1 - move : empty / 4;
+                uc col = move % 2 == 1 ? empty % 4 - 2 + move : empty % 4;
+                if ((row > 3) | (col > 3)) continue;
+                const uc target = row*4 + col;
+                int tile = -1;
+                for (int i = 0; i < k; i++) {
+                    if (cells[i] == target) tile = i;
+                }
+                cells[k] = target;
+                if (tile < 0) {
+                    uint32_t child = rank_cells(cells, k + 1);
+                    if (dist[child] > d) {
+                        dist[child] = d;
+                        current.push_back(child);
+                    }
+                } else {
+                    cells[tile] = empty;
+                    uint32_t child = rank_cells(cells, k + 1);
+                    if (dist[child] > d + 1) {
+                        dist[child] = d + 1;
+                        next.push_back(child);
+                    }
+                    cells[tile] = target;
+                }
+                cells[k] = empty;
+            }
+        }
+        std::swap(current, next);
+    }
+    // The empty cell is the last, radix 16 - k digit of the rank
+    std::vector<uc> table(placements(k), 0xFF);
+    for (uint32_t i = 0; i < dist.size(); i++) {
+        uc &best = table[i / (16 - k)];
+        if (dist[i] < best) best = dist[i];
+    }
+    return table;
+}
+
+// Generating takes a while and a few hundred megabytes, it is meant to be
+// done once with --generate-pdb and the file reused afterwards.
+bool save_pattern_database(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = true;
+    for (int pattern = 0; pattern < kPatternCount; pattern++) {
+        std::vector<uc> table = generate_pattern_table(pattern);
+        ok &= fwrite(table.data(), 1, table.size(), file) == table.size();
+    }
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+struct PatternDatabase {
+    void *mapping;
+    size_t mapping_size;
+    const uc *tables[kPatternCount];
+
+    PatternDatabase(): mapping(NULL), mapping_size(0) {}
+    ~PatternDatabase() {
+        if (mapping) munmap(mapping, mapping_size);
+    }
+    PatternDatabase(const PatternDatabase &source) = delete;
+    PatternDatabase& operator=(const PatternDatabase &source) = delete;
+
+    bool Load(const char *path) {
+        size_t expected = 0;
+        for (int i = 0; i < kPatternCount; i++) {
+            expected += placements(kPatternSizes[i]);
+        }
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if ((fstat(fd, &info) != 0) | ((size_t)info.st_size != expected)) {
+            close(fd);
+            return false;
+        }
+        void *data = mmap(NULL, expected, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return false;
+        mapping = data;
+        mapping_size = expected;
+        const uc *table = (const uc*)data;
+        for (int i = 0; i < kPatternCount; i++) {
+            tables[i] = table;
+            table += placements(kPatternSizes[i]);
+        }
+        return true;
+    }
+
+    int Estimate(const int mat[4][4]) const {
+        uc cell_of[16];
+        for (int i = 0; i < 16; i++) cell_of[mat[i / 4][i % 4]] = i;
+        int estimate = 0;
+        for (int i = 0; i < kPatternCount; i++) {
+            uc cells[6];
+            for (int j = 0; j < kPatternSizes[i]; j++) {
+                cells[j] = cell_of[kPatterns[i][j]];
+            }
+            estimate += tables[i][rank_cells(cells, kPatternSizes[i])];
+        }
+        return estimate;
+    }
+};
+
+// Iterative deepening A*: depth-first search on a single board with moves
+// made and unmade in place, memory is linear in the solution length.
+struct IdaSearch {
+    int mat[4][4];
+    uc empty_row;
+    uc empty_col;
+    bool found;
+    long long expanded;
+    std::deque<uc> path;
+    const PatternDatabase *pdb;
+
+    IdaSearch(st start, const PatternDatabase *pdb_) {
+        pdb = pdb_;
+        found = false;
+        expanded = 0;
+        for (int i = 3; i >= 0; i--) {
+            for (int j = 3; j >= 0; j--) {
+                mat[i][j] = start % 16;
+                if (mat[i][j] == 0) {
+                    empty_row = i;
+                    empty_col = j;
+                }
+                start = start >> 4;
+            }
+        }
+    }
+
+    int Heuristic() const {
+        int heuristic = Node::AdmissibleHeuristic(mat);
+        if (pdb) heuristic = std::max(heuristic, pdb->Estimate(mat));
+        return heuristic;
+    }
+
+    void MakeMove(uc row, uc col) {
+        mat[empty_row][empty_col] = mat[row][col];
+        mat[row][col] = 0;
+        empty_row = row;
+        empty_col = col;
+    }
+
+    // Returns the smallest f-value that exceeded the bound.
+    int Search(int dist, int bound, uc prev_move) {
+        int heuristic = Heuristic();
+        if (dist + heuristic > bound) return dist + heuristic;
+        if (heuristic == 0) {
+            found = true;
+            return dist;
+        }
+        expanded++;
+        int next_bound = INT_MAX;
+        for (uc move = 0; move < 4; move++) {
+            if ((move + 2) % 4 == prev_move) continue;
+            uc row = move % 2 == 0 ? empty_row + 1 - move : empty_row;
+            uc col = move % 2 == 1 ? empty_col - 2 + move : empty_col;
+            if ((row > 3) | (col > 3)) continue;
+            uc orig_row = empty_row;
+            uc orig_col = empty_col;
+            MakeMove(row, col);
+            path.push_back(move);
+            int result = Search(dist + 1, bound, move);
+            if (found) return result;
+            path.pop_back();
+            MakeMove(orig_row, orig_col);
+            if (result < next_bound) next_bound = result;
+        }
+        return next_bound;
+    }
+};
+
+// Finds an optimal solution, unlike the weighted A* of solve_fifteen.
+// Pattern databases, if given, sharpen the heuristic.
+std::deque<uc> solve_fifteen_ida(st start, const PatternDatabase *pdb = NULL,
+    long long *expanded = NULL) {
+    IdaSearch search(start, pdb);
+    int bound = search.Heuristic();
+    while (!search.found) bound = search.Search(0, bound, 4);
+    if (expanded) *expanded = search.expanded;
+    return search.path;
+}
+
 bool is_valid_and_solvable(st start) {
     std::set<int> knuckles_set;
     std::deque<int> knuckles_vec;
@@ -239,39 +1090,344 @@ bool is_valid_and_solvable(st start) {
     return !(bool)((inverse_pairs + empty % 4 + empty / 4) % 2);
 }
 
-int main() {
-    // std::ifstream input("in.txt");
-    st start = 0;
-    for (int i = 0; i < 16; i++) {
-        int current;
-        std::cin >> current;
-        // input >> current;
-        start = start << 4;
-        start = start | current;
-    }
-    if (!is_valid_and_solvable(start)) {
-        std::cout << -1 << '\n';
-        return 0;
-    }
-    std::deque<uc> moves = solve_fifteen(start);
-    std::cout << moves.size() << '\n';
+std::string moves_to_string(const std::deque<uc> &moves) {
+    std::string letters;
     for (int i = 0; i < moves.size(); i++) {
         uc curr_move = moves[i];
         switch (curr_move) {
             case 0:
-                std::cout << 'U';
+                letters += 'U';
                 break;
             case 1:
-                std::cout << 'R';
+                letters += 'R';
                 break;
             case 2:
-                std::cout << 'D';
+                letters += 'D';
                 break;
             case 3:
-                std::cout << 'L';
+                letters += 'L';
                 break;
         }
     }
-    std::cout << '\n';
+    return letters;
+}
+
+void print_moves(const std::deque<uc> &moves) {
+    std::cout << moves.size() << '\n';
+    std::cout << moves_to_string(moves) << '\n';
+}
+
+st read_board(std::istream &input) {
+    st board = 0;
+    for (int i = 0; i < 16; i++) {
+        int current;
+        input >> current;
+        board = board << 4;
+        board = board | current;
+    }
+    return board;
+}
+
+// Reads a board of any size, false if it is not a permutation of the tiles.
+template <typename NodeT>
+bool read_puzzle(std::istream &input, typename NodeT::State &board) {
+    unsigned long long seen = 0;
+    board = 0;
+    for (int i = 0; i < NodeT::kCells; i++) {
+        int current = -1;
+        input >> current;
+        if ((current < 0) | (current >= NodeT::kCells)) return false;
+        if ((seen >> current) & 1) return false;
+        seen |= 1ULL << current;
+        board = (board << NodeT::kBits) | (typename NodeT::State)current;
+    }
+    return true;
+}
+
+// Every move swaps the empty cell with a tile and shifts the empty cell by
+// one, so the parity of inversions plus its distance from the corner stays.
+template <typename NodeT>
+bool is_solvable_puzzle(typename NodeT::State board) {
+    int tiles[NodeT::kCells];
+    int parity = 0;
+    for (int i = NodeT::kCells - 1; i >= 0; i--) {
+        tiles[i] = (int)(board & NodeT::kMask);
+        if (tiles[i] == 0) {
+            tiles[i] = NodeT::kCells;
+            parity += NodeT::kRows - 1 - i / NodeT::kCols;
+            parity += NodeT::kCols - 1 - i % NodeT::kCols;
+        }
+        board = board >> NodeT::kBits;
+    }
+    for (int i = 0; i < NodeT::kCells; i++) {
+        for (int j = i + 1; j < NodeT::kCells; j++) {
+            if (tiles[i] > tiles[j]) parity++;
+        }
+    }
+    return parity % 2 == 0;
+}
+
+// Weighted A* on a board of another size, same output format.
+template <typename NodeT>
+void solve_puzzle_from(std::istream &input) {
+    typename NodeT::State start;
+    if (!read_puzzle<NodeT>(input, start) || !is_solvable_puzzle<NodeT>(start)) {
+        std::cout << -1 << '\n';
+        return;
+    }
+    PuzzleSearchSpace<NodeT> space;
+    print_moves(solve_puzzle<NodeT>(start, space));
+}
+
+struct BatchResult {
+    bool solvable;
+    std::deque<uc> moves;
+    double milliseconds;
+    long long expanded;
+};
+
+// Reads the number of boards and the boards, solves them on n_threads
+// threads and prints one line per board in input order: the number of moves
+// and the moves ("-" if there are none), solve time in milliseconds and the
+// number of expanded nodes. Unsolvable boards get -1.
+void solve_batch(std::istream &input, int n_threads, bool use_ida,
+    const PatternDatabase *pdb) {
+    int n_boards = 0;
+    input >> n_boards;
+    std::vector<st> boards(n_boards);
+    for (int i = 0; i < n_boards; i++) boards[i] = read_board(input);
+    std::vector<BatchResult> results(n_boards);
+    std::atomic<int> next_board(0);
+
+    auto worker = [&]() {
+        SearchSpace space;
+        for (int i = next_board++; i < n_boards; i = next_board++) {
+            BatchResult &result = results[i];
+            std::chrono::steady_clock::time_point begin =
+                std::chrono::steady_clock::now();
+            result.solvable = is_valid_and_solvable(boards[i]);
+            result.expanded = 0;
+            if (result.solvable) {
+                result.moves = use_ida
+                    ? solve_fifteen_ida(boards[i], pdb, &result.expanded)
+                    : solve_fifteen(boards[i], space, &result.expanded);
+            }
+            result.milliseconds = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - begin).count();
+        }
+    };
+
+    if (n_threads <= 0) n_threads = std::thread::hardware_concurrency();
+    if (n_threads <= 0) n_threads = 1;
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < n_threads; i++) helpers.push_back(std::thread(worker));
+    worker();
+    for (size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+
+    for (int i = 0; i < n_boards; i++) {
+        const BatchResult &result = results[i];
+        if (!result.solvable) {
+            std::cout << "-1 - 0 0\n";
+            continue;
+        }
+        std::string letters = moves_to_string(result.moves);
+        std::cout << result.moves.size() << ' '
+                  << (letters.empty() ? "-" : letters) << ' '
+                  << result.milliseconds << ' ' << result.expanded << '\n';
+    }
+}
+
+// Board reached by a random walk from the goal that never undoes the
+// previous move.
+st random_board(std::mt19937 &random, int n_moves) {
+    Node node = Node::FromState(0x123456789ABCDEF0ULL);
+    for (int i = 0; i < n_moves; i++) {
+        Node child;
+        child.heuristic = -1;
+        while (child.heuristic < 0) {
+            uc move = random() % 4;
+            if ((move + 2) % 4 != node.prev_move) child = node.SpawnChild(move);
+        }
+        node = child;
+    }
+    return node.state;
+}
+
+// Korf's instances put the empty cell first, tile t on cell t. Turning the
+// board around maps that goal onto ours and keeps moves legal.
+st from_korf_board(const int *cells) {
+    st board = 0;
+    for (int i = 15; i >= 0; i--) {
+        board = (board << 4) | (st)((16 - cells[i]) % 16);
+    }
+    return board;
+}
+
+// One board per line, 16 numbers with an optional leading instance number.
+bool read_korf_instances(const char *path, std::vector<st> &boards) {
+    std::ifstream input(path);
+    if (!input) return false;
+    std::string line;
+    while (std::getline(input, line)) {
+        std::istringstream numbers(line);
+        std::vector<int> cells;
+        int current;
+        while (numbers >> current) cells.push_back(current);
+        if (cells.size() < 16) continue;
+        boards.push_back(from_korf_board(&cells[cells.size() - 16]));
+    }
+    return true;
+}
+
+// Prints a CSV line per board for the selected solver: solution length,
+// expanded nodes, time, expansion rate and memory held by the visited
+// table and the open list. Easy and medium sets are random walks of a
+// fixed seed, Korf's 100 are read from korf_path when given.
+void run_benchmark(bool use_ida, bool use_hda, int n_threads,
+    const PatternDatabase *pdb, const char *korf_path) {
+    std::vector<std::string> set_names;
+    std::vector<std::vector<st> > sets;
+    std::mt19937 random(2024);
+    const int kWalks[2] = {30, 200};
+    const char *kWalkNames[2] = {"easy", "medium"};
+    for (int i = 0; i < 2; i++) {
+        set_names.push_back(kWalkNames[i]);
+        sets.push_back(std::vector<st>());
+        for (int j = 0; j < 10; j++) {
+            sets.back().push_back(random_board(random, kWalks[i]));
+        }
+    }
+    if (korf_path) {
+        set_names.push_back("korf");
+        sets.push_back(std::vector<st>());
+        if (!read_korf_instances(korf_path, sets.back())) {
+            std::cerr << "Cannot read " << korf_path << '\n';
+        }
+    }
+    const char *mode = use_hda ? "hda" : !use_ida ? "wastar" : pdb ? "ida-pdb" : "ida";
+    std::cout << "set,instance,mode,length,expanded,seconds,nodes_per_sec,"
+              << "visited_bytes,front_bytes\n";
+    for (size_t i = 0; i < sets.size(); i++) {
+        for (size_t j = 0; j < sets[i].size(); j++) {
+            st board = sets[i][j];
+            if (!is_valid_and_solvable(board)) {
+                std::cout << set_names[i] << ',' << j << ',' << mode
+                          << ",-1,0,0,0,0,0\n";
+                continue;
+            }
+            long long expanded = 0;
+            size_t visited_bytes = 0;
+            size_t front_bytes = 0;
+            std::deque<uc> moves;
+            std::chrono::steady_clock::time_point begin =
+                std::chrono::steady_clock::now();
+            if (use_hda) {
+                moves = solve_fifteen_hda(board, n_threads, &expanded,
+                    &visited_bytes, &front_bytes);
+            } else if (use_ida) {
+                moves = solve_fifteen_ida(board, pdb, &expanded);
+            } else {
+                SearchSpace space;
+                moves = solve_fifteen(board, space, &expanded);
+                visited_bytes = space.visited_pool.Bytes();
+                front_bytes = space.front_pool.Bytes();
+            }
+            double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+            std::cout << set_names[i] << ',' << j << ',' << mode << ','
+                      << moves.size() << ',' << expanded << ',' << seconds
+                      << ',' << (seconds > 0 ? expanded / seconds : 0) << ','
+                      << visited_bytes << ',' << front_bytes << '\n';
+            std::cout.flush();
+        }
+    }
+}
+
+// Pass --ida to get an optimal solution with IDA* instead of the default
+// weighted A*, --pdb <file> to run IDA* with pattern databases previously
+// written by --generate-pdb <file>. --batch [--threads N] solves many boards,
+// see solve_batch. --hda [--threads N] spreads one weighted A* over threads.
+// --size 3 or --size 5 solves the 8-puzzle or the 24-puzzle instead.
+// --bench [--korf <file>] prints CSV statistics of the selected solver, see
+// run_benchmark. --anytime <ms> keeps improving the weighted A* solution
+// until the time runs out, see solve_puzzle_anytime.
+int main(int argc, char **argv) {
+    bool use_ida = false;
+    bool batch = false;
+    bool use_hda = false;
+    int n_threads = 0;
+    int size = 4;
+    bool bench = false;
+    int anytime_ms = -1;
+    const char *korf_path = NULL;
+    const char *pdb_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ida") == 0) use_ida = true;
+        if (strcmp(argv[i], "--batch") == 0) batch = true;
+        if (strcmp(argv[i], "--hda") == 0) use_hda = true;
+        if (strcmp(argv[i], "--bench") == 0) bench = true;
+        if ((strcmp(argv[i], "--anytime") == 0) & (i + 1 < argc)) {
+            anytime_ms = atoi(argv[++i]);
+        }
+        if ((strcmp(argv[i], "--korf") == 0) & (i + 1 < argc)) {
+            korf_path = argv[++i];
+        }
+        if ((strcmp(argv[i], "--threads") == 0) & (i + 1 < argc)) {
+            n_threads = atoi(argv[++i]);
+        }
+        if ((strcmp(argv[i], "--size") == 0) & (i + 1 < argc)) {
+            size = atoi(argv[++i]);
+        }
+        if ((strcmp(argv[i], "--pdb") == 0) & (i + 1 < argc)) {
+            use_ida = true;
+            pdb_path = argv[++i];
+        } else if ((strcmp(argv[i], "--generate-pdb") == 0) & (i + 1 < argc)) {
+            if (!save_pattern_database(argv[i + 1])) {
+                std::cerr << "Cannot write " << argv[i + 1] << '\n';
+                return 1;
+            }
+            return 0;
+        }
+    }
+    if (size == 3) {
+        solve_puzzle_from<PuzzleNode<3, 3> >(std::cin);
+        return 0;
+    }
+    if (size == 5) {
+        solve_puzzle_from<PuzzleNode<5, 5> >(std::cin);
+        return 0;
+    }
+    PatternDatabase pdb;
+    if (pdb_path && !pdb.Load(pdb_path)) {
+        std::cerr << "Cannot load pattern databases from " << pdb_path << '\n';
+        return 1;
+    }
+    if (bench) {
+        run_benchmark(use_ida, use_hda, n_threads, pdb_path ? &pdb : NULL,
+            korf_path);
+        return 0;
+    }
+    if (batch) {
+        solve_batch(std::cin, n_threads, use_ida, pdb_path ? &pdb : NULL);
+        return 0;
+    }
+    // std::ifstream input("in.txt");
+    st start = read_board(std::cin);
+    if (!is_valid_and_solvable(start)) {
+        std::cout << -1 << '\n';
+        return 0;
+    }
+    std::deque<uc> moves;
+    if (use_ida) {
+        moves = solve_fifteen_ida(start, pdb_path ? &pdb : NULL);
+    } else if (use_hda) {
+        moves = solve_fifteen_hda(start, n_threads);
+    } else if (anytime_ms >= 0) {
+        SearchSpace space;
+        moves = solve_puzzle_anytime<Node>(start, space, anytime_ms);
+    } else {
+        moves = solve_fifteen(start);
+    }
+    print_moves(moves);
     return 0;
 }
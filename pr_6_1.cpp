@@ -8,250 +8,382 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <map>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "Deque.h"
 
-class Deque {
-    private:
-        int head;
-        void **buffer;
-        int tail;
-        int capacity;
-        void expand();
+/* --------------------------------------------------------- */
+
+const int kNoNode = -1;
+
+// Nodes live in the tree's arena and refer to each other by index.
+class Node {
     public:
-        Deque();
-        ~Deque();
-        int len();
-        void push_back(void *num);
-        void push_front(void *num);
-        void *pop_back();
-        void *pop_front();
-        void *peek_back();
-        void *peek_front();
+        int key;
+        int parent;
+        int left_child;
+        int right_child;
+        Node(int num);
 };
 
-Deque::Deque() {
-    head = 0;
-    tail = 0;
-    capacity = 1 << 8;
-    buffer = (void**)malloc(capacity*sizeof(void*));
+Node::Node(int num) {
+    parent = kNoNode;
+    left_child = kNoNode;
+    right_child = kNoNode;
+    key = num;
 }
 
-Deque::~Deque() {
-    free(buffer);
-}
+/* --------------------------------------------------------- */
 
-void Deque::expand() {
-    void **new_buffer = (void**)malloc((capacity << 1)*sizeof(void*));
-    int len = this->len();
-    for (int i = 0; i < len; i++) {
-        new_buffer[i] = buffer[(head + i)%capacity];
-    }
-    head = 0;
-    tail = len;
-    capacity = capacity << 1;
-    free(buffer);
-    buffer = new_buffer;
+// Read-only search structure built by BTree::freeze(). Keys are stored in
+// Eytzinger (BFS) order of an implicit complete tree, slots count from 1 and
+// 0 means "no slot".
+class FrozenBTree {
+    private:
+        int n_keys;
+        int *keys;
+        int *positions;
+        FrozenBTree(int n_keys_);
+        friend class BTree;
+    public:
+        ~FrozenBTree();
+        FrozenBTree(FrozenBTree &&source);
+        FrozenBTree(const FrozenBTree &source) = delete;
+        FrozenBTree& operator=(const FrozenBTree &source) = delete;
+        FrozenBTree& operator=(FrozenBTree &&source) = delete;
+        int size() const;
+        int lower_bound(int key) const;
+        int find(int key) const;
+        int key_at(int slot) const;
+        int preorder_position(int slot) const;
+};
+
+FrozenBTree::FrozenBTree(int n_keys_) {
+    n_keys = n_keys_;
+    keys = (int*)malloc((n_keys + 1)*sizeof(int));
+    positions = (int*)malloc((n_keys + 1)*sizeof(int));
 }
 
-int Deque::len() {
-    int len = (tail - head);
-    if (len < 0) len += capacity;
-    return len;
+FrozenBTree::~FrozenBTree() {
+    free(keys);
+    free(positions);
 }
 
-void Deque::push_back(void *num) {
-    if (len() == capacity - 1) expand();
-    buffer[tail] = num;
-    tail = (tail + 1)%capacity;
+FrozenBTree::FrozenBTree(FrozenBTree &&source) {
+    n_keys = source.n_keys;
+    keys = source.keys;
+    positions = source.positions;
+    source.n_keys = 0;
+    source.keys = NULL;
+    source.positions = NULL;
 }
 
-void Deque::push_front(void *num) {
-    if (len() == capacity - 1) expand();
-    head--;
-    if (head < 0) head += capacity;
-    buffer[head] = num;
+int FrozenBTree::size() const {
+    return n_keys;
 }
 
-void *Deque::pop_back() {
-    if (len() == 0) throw std::logic_error("Trying to pop an empty deque.");
-    tail--;
-    if (tail < 0) tail += capacity;
-    return buffer[tail];
+// Slot of the first key not less than the given one. The descent has no
+// branches to mispredict, and the 16 descendants four levels down share a
+// cache line which is requested in advance.
+int FrozenBTree::lower_bound(int key) const {
+    int slot = 1;
+    while (slot <= n_keys) {
+        __builtin_prefetch(keys + 16*slot);
+        slot = 2*slot + (keys[slot] < key);
+    }
+    slot >>= __builtin_ffs(~slot);
+    return slot;
 }
 
-void *Deque::pop_front() {
-    if (len() == 0) throw std::logic_error("Trying to pop an empty deque.");
-    void *num = buffer[head];
-    head = (head + 1)%capacity;
-    return num;
+int FrozenBTree::find(int key) const {
+    int slot = lower_bound(key);
+    return slot && keys[slot] == key ? slot : 0;
 }
 
-void *Deque::peek_back() {
-    if (len() == 0) throw std::logic_error("Trying to peek an empty deque.");
-    int m_tail = tail - 1;
-    if (m_tail < 0) m_tail += capacity;
-    return buffer[m_tail];
+int FrozenBTree::key_at(int slot) const {
+    return keys[slot];
 }
 
-void *Deque::peek_front() {
-    if (len() == 0) throw std::logic_error("Trying to peek an empty deque.");
-    return buffer[head];
+// Position of the node in the pre-order of the tree it was frozen from.
+int FrozenBTree::preorder_position(int slot) const {
+    return positions[slot];
 }
 
 /* --------------------------------------------------------- */
 
-class Node {
+class BTree {
+    private:
+        Node *nodes;
+        int n_nodes;
+        int capacity;
+        int root;
+        void reserve(int new_capacity);
+        int new_node(int num);
+        Node *at(int node);
+        int* child(int node, bool right);
+        void link_to(int node, int new_parent);
+        void unlink(int node);
+        void insert_node(int node);
+        int remove_root();
+        void remove(int node);
+        void parallel_traverse(std::vector<int> &keys, int n_threads,
+            bool mirrored);
     public:
-        int key;
-        Node *parent;
-        Node *left_child;
-        Node *right_child;
-        void link_to(Node *child);
-        void unlink();
-        Node** child(bool right);
-        Node(int num);
+        BTree();
+        ~BTree();
+        BTree(const BTree &source) = delete;
+        BTree(BTree &&source) = delete;
+        BTree& operator=(const BTree &source) = delete;
+        BTree& operator=(BTree &&source) = delete;
+        void insert(int num);
+        void build(const int *keys, int n_keys);
+        template <typename Visitor> void traverse_inorder(Visitor visit);
+        template <typename Visitor> void traverse_preorder(Visitor visit);
+        template <typename Visitor> void traverse_postorder(Visitor visit);
+        template <typename Visitor> void traverse_level(Visitor visit);
+        template <typename Visitor> void traverse_inorder_morris(Visitor visit);
+        template <typename Visitor> void traverse_preorder_morris(Visitor visit);
+
+        // Stackless iteration over parent links, O(1) extra memory.
+        template <bool Preorder>
+        class NodeIterator {
+            private:
+                Node *nodes;
+                int current;
+            public:
+                NodeIterator(Node *nodes_, int current_):
+                    nodes(nodes_), current(current_) {}
+                Node& operator*() const { return nodes[current]; }
+                Node* operator->() const { return nodes + current; }
+                bool operator==(const NodeIterator &other) const {
+                    return current == other.current;
+                }
+                bool operator!=(const NodeIterator &other) const {
+                    return current != other.current;
+                }
+                NodeIterator& operator++();
+        };
+        typedef NodeIterator<true> PreorderIterator;
+        typedef NodeIterator<false> InorderIterator;
+
+        template <typename Iterator>
+        class NodeRange {
+            private:
+                Iterator first;
+                Iterator last;
+            public:
+                NodeRange(Iterator first_, Iterator last_):
+                    first(first_), last(last_) {}
+                Iterator begin() const { return first; }
+                Iterator end() const { return last; }
+        };
+        NodeRange<PreorderIterator> preorder();
+        NodeRange<InorderIterator> inorder();
+
+        void parallel_preorder(std::vector<int> &keys, int n_threads = 0);
+        void parallel_postorder(std::vector<int> &keys, int n_threads = 0);
+
+        FrozenBTree freeze();
 };
 
-Node** Node::child(bool right) {
-    if (right) {
-        return &right_child;
-    } else {
-        return &left_child;
-    }
+BTree::BTree() {
+    nodes = NULL;
+    n_nodes = 0;
+    capacity = 0;
+    root = kNoNode;
 }
 
-void Node::link_to(Node *new_parent) {
-    parent = new_parent;
-    Node **to_insert = (parent->child)(parent->key <= key);
-    if (*to_insert)
-        throw std::logic_error("Cannot link to an occupied node!");
-    *to_insert = this;
+// All nodes are released at once together with the arena.
+BTree::~BTree() {
+    free(nodes);
 }
 
-void Node::unlink() {
-    if (parent) {
-        Node **to_free = (parent->child)(parent->key <= key);
-        if (*to_free != this)
-            throw std::logic_error("Parent-child link is corrupt!");
-        *to_free = NULL;
-        parent = NULL;
-    }
+// Indices stay valid when the arena moves, pointers to nodes do not.
+void BTree::reserve(int new_capacity) {
+    if (new_capacity <= capacity) return;
+    Node *new_nodes = (Node*)realloc(nodes, new_capacity*sizeof(Node));
+    if (!new_nodes) throw std::bad_alloc();
+    nodes = new_nodes;
+    capacity = new_capacity;
 }
 
-Node::Node(int num) {
-    parent = NULL;
-    left_child = NULL;
-    right_child = NULL;
-    key = num;
+int BTree::new_node(int num) {
+    if (n_nodes == capacity) reserve(capacity > 0 ? capacity << 1 : 1 << 8);
+    nodes[n_nodes] = Node(num);
+    return n_nodes++;
 }
 
-/* --------------------------------------------------------- */
+Node *BTree::at(int node) {
+    return node == kNoNode ? NULL : nodes + node;
+}
 
-class BTree {
-    private:
-        Node *root;
-        void insert(Node* node);
-        Node* remove_root();
-        void remove(Node* node);
-    public:
-        BTree();
-        ~BTree();
-        BTree(Node *node);
-        void insert(int num);
-        void traverse_inorder(void (*callback)(Node*, void*), void* arg);
-        void traverse_preorder(void (*callback)(Node*, void*), void* arg);
-        void traverse_postorder(void (*callback)(Node*, void*), void* arg);
-        void traverse_level(void (*callback)(Node*, void*), void* arg);
-};
+int* BTree::child(int node, bool right) {
+    if (right) {
+        return &nodes[node].right_child;
+    } else {
+        return &nodes[node].left_child;
+    }
+}
 
-BTree::BTree() {
-    root = NULL;
+void BTree::link_to(int node, int new_parent) {
+    nodes[node].parent = new_parent;
+    int *to_insert = child(new_parent, nodes[new_parent].key <= nodes[node].key);
+    if (*to_insert != kNoNode)
+        throw std::logic_error("Cannot link to an occupied node!");
+    *to_insert = node;
 }
 
-void BTree::insert(Node* node) {
-    if (!root) {
+void BTree::unlink(int node) {
+    int parent = nodes[node].parent;
+    if (parent != kNoNode) {
+        int *to_free = child(parent, nodes[parent].key <= nodes[node].key);
+        if (*to_free != node)
+            throw std::logic_error("Parent-child link is corrupt!");
+        *to_free = kNoNode;
+        nodes[node].parent = kNoNode;
+    }
+}
+
+void BTree::insert_node(int node) {
+    if (root == kNoNode) {
         root = node;
         return;
     }
 
-    Node* current = root;
+    int current = root;
     while (current != node) {
-        Node *child = *((current->child)(node->key >= current->key));
-        if (!child) {
-            node->link_to(current);
+        int next = *child(current, nodes[node].key >= nodes[current].key);
+        if (next == kNoNode) {
+            link_to(node, current);
             current = node;
         } else {
-            current = child;
+            current = next;
         }
     }
 }
 
 void BTree::insert(int num) {
-    Node *node = new Node(num);
-    insert(node);
+    insert_node(new_node(num));
+}
+
+// Builds the same tree as inserting the keys one by one, but in O(n log n):
+// a new key is attached to whichever of its in-order predecessor and
+// successor was inserted later. Equal keys go right, so in-order they follow
+// their insertion order: the successor is the first inserted node with the
+// next greater key and the predecessor is the last inserted one with a not
+// greater key. Node indices double as insertion times.
+void BTree::build(const int *keys, int n_keys) {
+    if (root != kNoNode)
+        throw std::logic_error("Cannot build into a non-empty tree!");
+    reserve(n_keys);
+    // key -> (first, last) node inserted with this key
+    std::map<int, std::pair<int, int> > index;
+    for (int i = 0; i < n_keys; i++) {
+        int node = new_node(keys[i]);
+        std::map<int, std::pair<int, int> >::iterator successor =
+            index.upper_bound(keys[i]);
+        std::map<int, std::pair<int, int> >::iterator predecessor =
+            successor;
+        int parent = kNoNode;
+        if (successor != index.end()) {
+            parent = successor->second.first;
+        }
+        if (predecessor != index.begin()) {
+            predecessor--;
+            if (predecessor->second.second > parent) {
+                parent = predecessor->second.second;
+            }
+        }
+        if (parent != kNoNode) {
+            link_to(node, parent);
+        } else {
+            root = node;
+        }
+        if (predecessor != successor && predecessor->first == keys[i]) {
+            predecessor->second.second = node;
+        } else {
+            index.insert(successor,
+                std::make_pair(keys[i], std::make_pair(node, node)));
+        }
+    }
 }
 
-Node* BTree::remove_root() {
-    if (root->parent)
+int BTree::remove_root() {
+    if (nodes[root].parent != kNoNode)
         throw std::logic_error("Cannot remove root from a non-free tree!");
 
-    Node *old_root = root;
-    Node *new_root = root->right_child;
+    int old_root = root;
+    int new_root = nodes[root].right_child;
     bool right_side = true;
 
-    if (!new_root) {
-        new_root = root->left_child;
+    if (new_root == kNoNode) {
+        new_root = nodes[root].left_child;
         right_side = false;
     }
-    if (!new_root) {
-        root = NULL;
+    if (new_root == kNoNode) {
+        root = kNoNode;
         return old_root;
     }
 
-    while (*(new_root->child(!right_side))) {
-        new_root = *(new_root->child(!right_side));
+    while (*child(new_root, !right_side) != kNoNode) {
+        new_root = *child(new_root, !right_side);
     }
 
-    new_root->unlink();
-    if (*(new_root->child)(right_side)) {
-        (*(new_root->child)(right_side))->unlink();
-        (*(new_root->child)(right_side))->link_to(new_root->parent);
+    int new_root_parent = nodes[new_root].parent;
+    unlink(new_root);
+    int orphan = *child(new_root, right_side);
+    if (orphan != kNoNode) {
+        unlink(orphan);
+        link_to(orphan, new_root_parent);
     }
 
-    if (root->left_child) {
-        (root->left_child)->unlink();
-        (root->left_child)->link_to(new_root);
+    int lc = nodes[root].left_child;
+    if (lc != kNoNode) {
+        unlink(lc);
+        link_to(lc, new_root);
     }
 
-    if (root->right_child) {
-        (root->left_child)->unlink();
-        (root->right_child)->link_to(new_root);
+    int rc = nodes[root].right_child;
+    if (rc != kNoNode) {
+        unlink(rc);
+        link_to(rc, new_root);
     }
 
     root = new_root;
     return old_root;
 }
 
-void BTree::remove(Node *node) {
-    Node *parent = node->parent;
-    node->unlink();
-    BTree node_tree = BTree(node);
-    node_tree.remove_root();
-    (node_tree.root)->link_to(parent);
+void BTree::remove(int node) {
+    int parent = nodes[node].parent;
+    unlink(node);
+    int orig_root = root;
+    root = node;
+    remove_root();
+    int sub_root = root;
+    root = orig_root;
+    if (sub_root != kNoNode) link_to(sub_root, parent);
 }
 
-void BTree::traverse_inorder(void (*callback)(Node*, void*), void* arg) {
-    if (!root) {
+template <typename Visitor>
+void BTree::traverse_inorder(Visitor visit) {
+    if (root == kNoNode) {
         return;
     }
-    Deque stack;
-    stack.push_back(root);
+    Deque<Node*> stack;
+    stack.push_back(at(root));
     bool going_down = true;
     while (stack.len() > 0) {
-        Node *current = (Node*)stack.peek_back();
-        Node *lc = current->left_child;
-        Node *rc = current->right_child;
+        Node *current = stack.peek_back();
+        Node *lc = at(current->left_child);
+        Node *rc = at(current->right_child);
         if ((!going_down) || (!lc)) {
-            (*callback)(current, arg);
+            visit(current);
             going_down = false;
             stack.pop_back();
             if (rc) {going_down = true; stack.push_back(rc);}
@@ -261,35 +393,37 @@ void BTree::traverse_inorder(void (*callback)(Node*, void*), void* arg) {
     }
 }
 
-void BTree::traverse_preorder(void (*callback)(Node*, void*), void* arg) {
-    if (!root) {
+template <typename Visitor>
+void BTree::traverse_preorder(Visitor visit) {
+    if (root == kNoNode) {
         return;
     }
-    Deque stack;
-    stack.push_back(root);
+    Deque<Node*> stack;
+    stack.push_back(at(root));
     while (stack.len() > 0) {
-        Node *current = (Node*)stack.pop_back();
-        Node *lc = current->left_child;
-        Node *rc = current->right_child;
-        (*callback)(current, arg);
+        Node *current = stack.pop_back();
+        Node *lc = at(current->left_child);
+        Node *rc = at(current->right_child);
+        visit(current);
         if (rc) stack.push_back(rc);
         if (lc) stack.push_back(lc);
     }
 }
 
-void BTree::traverse_postorder(void (*callback)(Node*, void*), void* arg) {
-    if (!root) {
+template <typename Visitor>
+void BTree::traverse_postorder(Visitor visit) {
+    if (root == kNoNode) {
         return;
     }
-    Deque stack;
-    Deque sec_stack;
-    stack.push_back(root);
+    Deque<Node*> stack;
+    Deque<Node*> sec_stack;
+    stack.push_back(at(root));
     sec_stack.push_back(NULL);
     bool going_down = true;
     while (stack.len() > 0) {
-        Node *current = (Node*)stack.peek_back();
-        Node *lc = current->left_child;
-        Node *rc = current->right_child;
+        Node *current = stack.peek_back();
+        Node *lc = at(current->left_child);
+        Node *rc = at(current->right_child);
         if (going_down) {
             if (lc) {
                 stack.push_back(lc);
@@ -312,45 +446,281 @@ void BTree::traverse_postorder(void (*callback)(Node*, void*), void* arg) {
             }
         }
         going_down = false;
-        (*callback)(current, arg);
+        visit(current);
         stack.pop_back();
     }
 }
 
-void BTree::traverse_level(void (*callback)(Node*, void*), void* arg) {
-    if (!root) {
+template <typename Visitor>
+void BTree::traverse_level(Visitor visit) {
+    if (root == kNoNode) {
         return;
     }
-    Deque queue;
-    queue.push_back(root);
+    Deque<Node*> queue;
+    queue.push_back(at(root));
     while (queue.len() > 0) {
-        Node *current = (Node*)queue.pop_front();
-        Node *lc = current->left_child;
-        Node *rc = current->right_child;
+        Node *current = queue.pop_front();
+        Node *lc = at(current->left_child);
+        Node *rc = at(current->right_child);
         if (lc) queue.push_back(lc);
         if (rc) queue.push_back(rc);
 
-        (*callback)(current, arg);
+        visit(current);
     }
 }
 
-void print_key_and_delete(Node *node, void* ) {
-    std::cout << node->key << " ";
-    delete node;
+// Morris traversals thread the tree through empty right links instead of
+// keeping a stack. The links are restored by the time the traversal ends, so
+// the visitor must not look at them or stop the traversal with an exception.
+template <typename Visitor>
+void BTree::traverse_inorder_morris(Visitor visit) {
+    int current = root;
+    while (current != kNoNode) {
+        int lc = nodes[current].left_child;
+        if (lc == kNoNode) {
+            visit(nodes + current);
+            current = nodes[current].right_child;
+            continue;
+        }
+        int predecessor = lc;
+        while (nodes[predecessor].right_child != kNoNode
+            && nodes[predecessor].right_child != current) {
+            predecessor = nodes[predecessor].right_child;
+        }
+        if (nodes[predecessor].right_child == kNoNode) {
+            nodes[predecessor].right_child = current;
+            current = lc;
+        } else {
+            nodes[predecessor].right_child = kNoNode;
+            visit(nodes + current);
+            current = nodes[current].right_child;
+        }
+    }
+}
+
+template <typename Visitor>
+void BTree::traverse_preorder_morris(Visitor visit) {
+    int current = root;
+    while (current != kNoNode) {
+        int lc = nodes[current].left_child;
+        if (lc == kNoNode) {
+            visit(nodes + current);
+            current = nodes[current].right_child;
+            continue;
+        }
+        int predecessor = lc;
+        while (nodes[predecessor].right_child != kNoNode
+            && nodes[predecessor].right_child != current) {
+            predecessor = nodes[predecessor].right_child;
+        }
+        if (nodes[predecessor].right_child == kNoNode) {
+            visit(nodes + current);
+            nodes[predecessor].right_child = current;
+            current = lc;
+        } else {
+            nodes[predecessor].right_child = kNoNode;
+            current = nodes[current].right_child;
+        }
+    }
+}
+
+template <>
+BTree::PreorderIterator& BTree::PreorderIterator::operator++() {
+    const Node &node = nodes[current];
+    if (node.left_child != kNoNode) {
+        current = node.left_child;
+        return *this;
+    }
+    if (node.right_child != kNoNode) {
+        current = node.right_child;
+        return *this;
+    }
+    int child = current;
+    int parent = node.parent;
+    while (parent != kNoNode && (nodes[parent].right_child == child
+        || nodes[parent].right_child == kNoNode)) {
+        child = parent;
+        parent = nodes[parent].parent;
+    }
+    current = parent == kNoNode ? kNoNode : nodes[parent].right_child;
+    return *this;
+}
+
+template <>
+BTree::InorderIterator& BTree::InorderIterator::operator++() {
+    if (nodes[current].right_child != kNoNode) {
+        current = nodes[current].right_child;
+        while (nodes[current].left_child != kNoNode) {
+            current = nodes[current].left_child;
+        }
+        return *this;
+    }
+    int child = current;
+    current = nodes[current].parent;
+    while (current != kNoNode && nodes[current].right_child == child) {
+        child = current;
+        current = nodes[current].parent;
+    }
+    return *this;
+}
+
+BTree::NodeRange<BTree::PreorderIterator> BTree::preorder() {
+    return NodeRange<PreorderIterator>(PreorderIterator(nodes, root),
+        PreorderIterator(nodes, kNoNode));
+}
+
+BTree::NodeRange<BTree::InorderIterator> BTree::inorder() {
+    int first = root;
+    while (first != kNoNode && nodes[first].left_child != kNoNode) {
+        first = nodes[first].left_child;
+    }
+    return NodeRange<InorderIterator>(InorderIterator(nodes, first),
+        InorderIterator(nodes, kNoNode));
+}
+
+// Trees smaller than this are dumped by a single thread.
+const int kParallelGrain = 1 << 16;
+// How many nodes a worker visits between checks for idle workers.
+const int kDonateInterval = 1 << 10;
+
+struct TraversalChunk {
+    std::vector<int> keys;
+    TraversalChunk *next;
+};
+
+// Pre-order dump split between threads. Nodes do not know their subtree
+// sizes, so instead of cutting the tree up front a busy worker hands the
+// bottom entry of its stack to an idle one. That entry is the last thing the
+// donor would visit, so its output goes right after the donor's chunk.
+// The mirrored order (right before left) reversed gives the post-order.
+void BTree::parallel_traverse(std::vector<int> &keys, int n_threads,
+    bool mirrored) {
+    keys.clear();
+    if (root == kNoNode) return;
+    if (n_threads <= 0) n_threads = std::thread::hardware_concurrency();
+    if (n_threads <= 0 || n_nodes < kParallelGrain) n_threads = 1;
+
+    std::deque<TraversalChunk> chunks;
+    std::vector<std::pair<int, TraversalChunk*> > tasks;
+    std::mutex lock;
+    std::condition_variable wake;
+    int idle = 0;
+    std::atomic<int> n_idle(0);
+    bool finished = false;
+    chunks.push_back(TraversalChunk());
+    chunks.back().next = NULL;
+    tasks.push_back(std::make_pair(root, &chunks.back()));
+
+    auto worker = [&]() {
+        Deque<int> stack;
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            if (tasks.empty()) {
+                idle++;
+                n_idle.store(idle);
+                if (idle == n_threads) {
+                    finished = true;
+                    wake.notify_all();
+                }
+                while (tasks.empty() && !finished) wake.wait(guard);
+                if (finished) return;
+                idle--;
+                n_idle.store(idle);
+            }
+            TraversalChunk *chunk = tasks.back().second;
+            stack.push_back(tasks.back().first);
+            tasks.pop_back();
+            guard.unlock();
+            int since_check = 0;
+            while (stack.len() > 0) {
+                if (++since_check == kDonateInterval) {
+                    since_check = 0;
+                    if (stack.len() > 1 && n_idle.load() > 0) {
+                        int donated = stack.pop_front();
+                        guard.lock();
+                        chunks.push_back(TraversalChunk());
+                        TraversalChunk *donated_chunk = &chunks.back();
+                        donated_chunk->next = chunk->next;
+                        chunk->next = donated_chunk;
+                        tasks.push_back(std::make_pair(donated, donated_chunk));
+                        guard.unlock();
+                        wake.notify_one();
+                    }
+                }
+                const Node &current = nodes[stack.pop_back()];
+                chunk->keys.push_back(current.key);
+                int first = current.left_child;
+                int second = current.right_child;
+                if (mirrored) std::swap(first, second);
+                if (second != kNoNode) stack.push_back(second);
+                if (first != kNoNode) stack.push_back(first);
+            }
+            guard.lock();
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < n_threads; i++) helpers.push_back(std::thread(worker));
+    worker();
+    for (int i = 0; i < (int)helpers.size(); i++) helpers[i].join();
+
+    keys.reserve(n_nodes);
+    for (TraversalChunk *chunk = &chunks.front(); chunk; chunk = chunk->next) {
+        keys.insert(keys.end(), chunk->keys.begin(), chunk->keys.end());
+    }
+    if (mirrored) std::reverse(keys.begin(), keys.end());
+}
+
+void BTree::parallel_preorder(std::vector<int> &keys, int n_threads) {
+    parallel_traverse(keys, n_threads, false);
+}
+
+void BTree::parallel_postorder(std::vector<int> &keys, int n_threads) {
+    parallel_traverse(keys, n_threads, true);
+}
+
+// In-order of the tree gives the keys sorted, in-order of the implicit
+// Eytzinger tree gives the slots they go to.
+FrozenBTree BTree::freeze() {
+    FrozenBTree frozen(n_nodes);
+    int *preorder_positions = (int*)malloc(n_nodes*sizeof(int));
+    int position = 0;
+    for (Node &node : preorder()) {
+        preorder_positions[&node - nodes] = position++;
+    }
+    int slot = 1;
+    while (2*slot <= n_nodes) slot *= 2;
+    for (Node &node : inorder()) {
+        frozen.keys[slot] = node.key;
+        frozen.positions[slot] = preorder_positions[&node - nodes];
+        if (2*slot + 1 <= n_nodes) {
+            slot = 2*slot + 1;
+            while (2*slot <= n_nodes) slot *= 2;
+        } else {
+            while (slot & 1) slot >>= 1;
+            slot >>= 1;
+        }
+    }
+    free(preorder_positions);
+    return frozen;
 }
 
 int main() {
     int n_nodes;
     std::cin >> n_nodes;
 
-    BTree tree = BTree();
+    int *keys = (int*)malloc(n_nodes*sizeof(int));
     for (int i = 0; i < n_nodes; i++) {
-        int key;
-        std::cin >> key;
-        tree.insert(key);
+        std::cin >> keys[i];
     }
 
-    tree.traverse_preorder(&print_key_and_delete, NULL);
+    BTree tree;
+    tree.build(keys, n_nodes);
+    free(keys);
+
+    for (Node &node : tree.preorder()) {
+        std::cout << node.key << " ";
+    }
     std::cout << std::endl;
 
     return 0;
@@ -20,131 +20,14 @@
 #include <stdexcept>
 #include <ctime>
 #include <cstring>
-
-template <typename T>
-class Deque {
-    private:
-        int head;
-        T *buffer;
-        int tail;
-        int capacity;
-        void expand();
-    public:
-        Deque();
-        ~Deque();
-        Deque(const Deque<T> &source);
-        Deque(Deque<T> &&source) = delete;
-        Deque& operator=(const Deque<T> &source);
-        Deque& operator=(Deque<T> &&source) = delete;
-        int len() const;
-        void push_back(T item);
-        void push_front(T item);
-        T pop_back();
-        T pop_front();
-        T peek_back();
-        T peek_front();
-};
-
-template <typename T>
-Deque<T>::Deque() {
-    head = 0;
-    tail = 0;
-    capacity = 1 << 8;
-    buffer = (T*)malloc(capacity*sizeof(T));
-}
-
-template <typename T>
-Deque<T>::~Deque() {
-    free(buffer);
-}
-
-template <typename T>
-Deque<T>::Deque(const Deque<T> &source) {
-    head = source.head;
-    tail = source.tail;
-    capacity = source.capacity;
-    buffer = (T*)malloc(capacity*sizeof(T));
-    memcpy(buffer, source.buffer, capacity*sizeof(T));
-}
-
-template <typename T>
-Deque<T>& Deque<T>::operator= (const Deque<T> &source) {
-    head = source.head;
-    tail = source.tail;
-    capacity = source.capacity;
-    free(buffer);
-    buffer = (T*)malloc(capacity*sizeof(T));
-    memcpy(buffer, source.buffer, capacity*sizeof(T));
-}
-
-template <typename T>
-void Deque<T>::expand() {
-    T *new_buffer = (T*)malloc((capacity << 1)*sizeof(T));
-    const int len = this->len();
-    if (head <= tail) {
-        memcpy(new_buffer, buffer + head, len*sizeof(T));
-    } else {
-        memcpy(new_buffer, buffer + head, (capacity - head)*sizeof(T));
-        memcpy(new_buffer + (capacity - head), buffer, tail*sizeof(T));
-    }
-    head = 0;
-    tail = len;
-    capacity = capacity << 1;
-    free(buffer);
-    buffer = new_buffer;
-}
-
-template <typename T>
-int Deque<T>::len() const {
-    int len = (tail - head);
-    if (len < 0) len += capacity;
-    return len;
-}
-
-template <typename T>
-void Deque<T>::push_back(T item) {
-    if (len() == capacity - 1) expand();
-    buffer[tail] = item;
-    tail = (tail + 1)%capacity;
-}
-
-template <typename T>
-void Deque<T>::push_front(T item) {
-    if (len() == capacity - 1) expand();
-    head--;
-    if (head < 0) head += capacity;
-    buffer[head] = item;
-}
-
-template <typename T>
-T Deque<T>::pop_back() {
-    if (len() == 0) std::logic_error("Trying to pop an empty deque.");
-    tail--;
-    if (tail < 0) tail += capacity;
-    return buffer[tail];
-}
-
-template <typename T>
-T Deque<T>::pop_front() {
-    if (len() == 0) std::logic_error("Trying to pop an empty deque.");
-    T item = buffer[head];
-    head = (head + 1)%capacity;
-    return item;
-}
-
-template <typename T>
-T Deque<T>::peek_back() {
-    if (len() == 0) std::logic_error("Trying to peek an empty deque.");
-    int m_tail = tail - 1;
-    if (m_tail < 0) m_tail += capacity;
-    return buffer[m_tail];
-}
-
-template <typename T>
-T Deque<T>::peek_front() {
-    if (len() == 0) std::logic_error("Trying to peek an empty deque.");
-    return buffer[head];
-}
+#include <memory>
+#include <utility>
+#include <future>
+#include <thread>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "Deque.h"
 
 /* ------------------------------------------------------------------------- */
 /* ------------------------------------------------------------------------- */
@@ -163,17 +46,31 @@ class CartTree {
     private:
     Node *root;
 
-    bool gt(int x, int y, bool eq);
-    Node **GetChild(Node *node, bool right);
-    Node *DropChild(Node *node, bool right);
-    Node *Split(int key, bool to_right = false);
-    void Merge(Node *sub_root);
+    static bool gt(int x, int y, bool eq);
+    static Node **GetChild(Node *node, bool right);
+    static Node *DropChild(Node *node, bool right);
+    static Node *Split(Node *&root, int key, bool to_right = false);
+    static void Merge(Node *&root, Node *sub_root);
+    static void FreeSubtree(Node *sub_root);
+    static void UpdateRank(Node *node);
+    static void SplitAround(Node *sub_root, int key,
+        Node *&less, Node *&equal, Node *&greater);
+    static void SplitPair(Node *first, Node *second,
+        Node **first_parts, Node **second_parts);
+    static Node *Concat(Node *less, Node *equal, Node *greater);
+    static int ForkDepth();
+    static Node *Union(Node *first, Node *second, int fork_depth);
+    static Node *Intersect(Node *first, Node *second, int fork_depth);
+    static Node *Difference(Node *first, Node *second, int fork_depth);
 
 
     public:
     void Insert(int key);
     void Delete(int key);
     Node *GetByOrder(int order);
+    void Union(CartTree &other);
+    void Intersect(CartTree &other);
+    void Difference(CartTree &other);
     CartTree();
     ~CartTree();
     CartTree(const CartTree &source);
@@ -188,17 +85,7 @@ CartTree::CartTree() {
 }
 
 CartTree::~CartTree() {
-    if (!root) return;
-    Deque<Node*> stack;
-    stack.push_back(root);
-    while (stack.len() > 0) {
-        Node *current = stack.pop_back();
-        Node *lc = current->left_child;
-        Node *rc = current->right_child;
-        delete current;
-        if (rc) stack.push_back(rc);
-        if (lc) stack.push_back(lc);
-    }
+    FreeSubtree(root);
 }
 
 CartTree::CartTree(const CartTree &source) {
@@ -230,18 +117,7 @@ CartTree::CartTree(const CartTree &source) {
 }
 
 CartTree& CartTree::operator= (const CartTree &source) {
-    if (root) {
-        Deque<Node*> stack;
-        stack.push_back(root);
-        while (stack.len() > 0) {
-            Node *current = stack.pop_back();
-            Node *lc = current->left_child;
-            Node *rc = current->right_child;
-            delete current;
-            if (rc) stack.push_back(rc);
-            if (lc) stack.push_back(lc);
-        }
-    }
+    FreeSubtree(root);
     if (!source.root)  {
         root = NULL;
         return *this;
@@ -284,7 +160,27 @@ bool CartTree::gt(int x, int y, bool eq) {
     return !eq ? x > y : x >= y;
 }
 
-Node *CartTree::Split(int key, bool to_right) {
+void CartTree::FreeSubtree(Node *sub_root) {
+    if (!sub_root) return;
+    Deque<Node*> stack;
+    stack.push_back(sub_root);
+    while (stack.len() > 0) {
+        Node *current = stack.pop_back();
+        Node *lc = current->left_child;
+        Node *rc = current->right_child;
+        delete current;
+        if (rc) stack.push_back(rc);
+        if (lc) stack.push_back(lc);
+    }
+}
+
+void CartTree::UpdateRank(Node *node) {
+    node->rank = 1;
+    if (node->left_child) node->rank += node->left_child->rank;
+    if (node->right_child) node->rank += node->right_child->rank;
+}
+
+Node *CartTree::Split(Node *&root, int key, bool to_right) {
     if (!root) return NULL;
     Node *sub_root = root;
     Deque<Node*> stack;
@@ -294,17 +190,14 @@ Node *CartTree::Split(int key, bool to_right) {
         if (!sub_root) return NULL;
     }
     Node *border = stack.peek_back();
-    Node *orig_root = root;
-    root = sub_root;
-    Node *sub_sub_root = Split(key, to_right);
-    root = orig_root;
+    Node *sub_sub_root = Split(sub_root, key, to_right);
     *GetChild(border, !gt(root->key, key, to_right)) = sub_sub_root;
     while (stack.len() > 0) (stack.pop_back())->rank -= sub_root->rank;
     return sub_root;
 }
 
 // Assume that all keys in one tree are not smaller than keys in another tree
-void CartTree::Merge(Node *sub_root) {
+void CartTree::Merge(Node *&root, Node *sub_root) {
     if (!sub_root) return;
     if (!root) {
         root = sub_root;
@@ -326,10 +219,7 @@ void CartTree::Merge(Node *sub_root) {
     if (sub_sub_root) rank_delta -= sub_sub_root->rank;
     higher = stack.peek_back();
     *GetChild(higher, right_descent) = lower;
-    Node* orig_root = root;
-    root = lower;
-    Merge(sub_sub_root);
-    root = orig_root;
+    Merge(lower, sub_sub_root);
     rank_delta += lower->rank;
     while (stack.len() > 0) (stack.pop_back())->rank += rank_delta;
 }
@@ -342,7 +232,7 @@ void CartTree::Insert(int key) {
         root = new_node;
         return;
     }
-    Node *sub_root = Split(key);
+    Node *sub_root = Split(root, key);
     if (root->key > key) {
         Node *temp = root;
         root = sub_root;
@@ -350,23 +240,23 @@ void CartTree::Insert(int key) {
     }
     if (!root) {
         root = new_node;
-        Merge(sub_root);
+        Merge(root, sub_root);
         return;
     }
-    Node *sub_sub_root = Split(key, true);
+    Node *sub_sub_root = Split(root, key, true);
     if (root->key < key) {
         Node *temp = root;
         root = sub_sub_root;
         sub_sub_root = temp;
     }
-    Merge(new_node);
-    Merge(sub_sub_root);
-    Merge(sub_root);    
+    Merge(root, new_node);
+    Merge(root, sub_sub_root);
+    Merge(root, sub_root);
 }
 
 void CartTree::Delete(int key) {
     if (!root) return;
-    Node *sub_root = Split(key);
+    Node *sub_root = Split(root, key);
     if (root->key > key) {
         Node *temp = root;
         root = sub_root;
@@ -376,7 +266,7 @@ void CartTree::Delete(int key) {
         root = sub_root;
         return;
     }
-    Node *sub_sub_root = Split(key, true);
+    Node *sub_sub_root = Split(root, key, true);
     if (root->key < key) {
         Node *temp = root;
         root = sub_sub_root;
@@ -387,8 +277,8 @@ void CartTree::Delete(int key) {
         root = root->right_child;
         delete temp;
     }
-    Merge(sub_sub_root);
-    Merge(sub_root);
+    Merge(root, sub_sub_root);
+    Merge(root, sub_root);
 }
 
 Node* CartTree::GetByOrder(int order) {
@@ -413,8 +303,684 @@ Node* CartTree::GetByOrder(int order) {
     return current;
 }
 
+// Splits sub_root into keys less than, equal to and greater than key.
+void CartTree::SplitAround(Node *sub_root, int key,
+    Node *&less, Node *&equal, Node *&greater) {
+    less = NULL;
+    equal = NULL;
+    greater = NULL;
+    if (!sub_root) return;
+    Node *other = Split(sub_root, key);
+    if (sub_root->key > key) std::swap(sub_root, other);
+    greater = other;
+    if (!sub_root) return;
+    other = Split(sub_root, key, true);
+    if (sub_root->key < key) std::swap(sub_root, other);
+    less = other;
+    equal = sub_root;
+}
+
+// Subproblems smaller than this are not worth a separate thread.
+const int kParallelGrain = 1 << 14;
+
+int CartTree::ForkDepth() {
+    unsigned n_threads = std::thread::hardware_concurrency();
+    int depth = 0;
+    while ((1u << depth) < n_threads) depth++;
+    return n_threads > 1 ? depth + 1 : 0;
+}
+
+// Splits both trees around the key of the root with the higher priority,
+// parts are keys less than, equal to and greater than it.
+void CartTree::SplitPair(Node *first, Node *second,
+    Node **first_parts, Node **second_parts) {
+    int key = first->priority >= second->priority ? first->key : second->key;
+    SplitAround(first, key, first_parts[0], first_parts[1], first_parts[2]);
+    SplitAround(second, key, second_parts[0], second_parts[1], second_parts[2]);
+}
+
+// Parts must hold strictly increasing keys, as SplitAround leaves them.
+Node *CartTree::Concat(Node *less, Node *equal, Node *greater) {
+    Merge(less, equal);
+    Merge(less, greater);
+    return less;
+}
+
+// The set operations below are join-based: both trees are split around the
+// key of the root with the higher priority, the halves below and above it
+// are processed independently, in parallel while fork_depth allows, and
+// the result is joined back around the copies of the key that are kept.
+// first belongs to this tree and second to other; copies of a key are kept
+// or dropped all together, and kept copies always come from one side only.
+// Both arguments are consumed, the result reuses their nodes.
+Node *CartTree::Union(Node *first, Node *second, int fork_depth) {
+    if (!first) return second;
+    if (!second) return first;
+    bool fork = fork_depth > 0 && first->rank + second->rank >= kParallelGrain;
+    Node *mine[3], *theirs[3];
+    SplitPair(first, second, mine, theirs);
+    if (mine[1]) {
+        FreeSubtree(theirs[1]);
+    } else {
+        mine[1] = theirs[1];
+    }
+    Node *less, *greater;
+    if (fork) {
+        std::future<Node*> left = std::async(std::launch::async,
+            [=]() { return Union(mine[0], theirs[0], fork_depth - 1); });
+        greater = Union(mine[2], theirs[2], fork_depth - 1);
+        less = left.get();
+    } else {
+        less = Union(mine[0], theirs[0], 0);
+        greater = Union(mine[2], theirs[2], 0);
+    }
+    return Concat(less, mine[1], greater);
+}
+
+Node *CartTree::Intersect(Node *first, Node *second, int fork_depth) {
+    if (!first || !second) {
+        FreeSubtree(first);
+        FreeSubtree(second);
+        return NULL;
+    }
+    bool fork = fork_depth > 0 && first->rank + second->rank >= kParallelGrain;
+    Node *mine[3], *theirs[3];
+    SplitPair(first, second, mine, theirs);
+    if (!theirs[1]) {
+        FreeSubtree(mine[1]);
+        mine[1] = NULL;
+    }
+    FreeSubtree(theirs[1]);
+    Node *less, *greater;
+    if (fork) {
+        std::future<Node*> left = std::async(std::launch::async,
+            [=]() { return Intersect(mine[0], theirs[0], fork_depth - 1); });
+        greater = Intersect(mine[2], theirs[2], fork_depth - 1);
+        less = left.get();
+    } else {
+        less = Intersect(mine[0], theirs[0], 0);
+        greater = Intersect(mine[2], theirs[2], 0);
+    }
+    return Concat(less, mine[1], greater);
+}
+
+Node *CartTree::Difference(Node *first, Node *second, int fork_depth) {
+    if (!first) {
+        FreeSubtree(second);
+        return NULL;
+    }
+    if (!second) return first;
+    bool fork = fork_depth > 0 && first->rank + second->rank >= kParallelGrain;
+    Node *mine[3], *theirs[3];
+    SplitPair(first, second, mine, theirs);
+    if (theirs[1]) {
+        FreeSubtree(mine[1]);
+        mine[1] = NULL;
+    }
+    FreeSubtree(theirs[1]);
+    Node *less, *greater;
+    if (fork) {
+        std::future<Node*> left = std::async(std::launch::async,
+            [=]() { return Difference(mine[0], theirs[0], fork_depth - 1); });
+        greater = Difference(mine[2], theirs[2], fork_depth - 1);
+        less = left.get();
+    } else {
+        less = Difference(mine[0], theirs[0], 0);
+        greater = Difference(mine[2], theirs[2], 0);
+    }
+    return Concat(less, mine[1], greater);
+}
+
+// Adds the keys of other that are not present here; for a key present in
+// both trees every copy from this tree is kept and every copy from other is
+// dropped. other is emptied.
+void CartTree::Union(CartTree &other) {
+    if (&other == this) return;
+    root = Union(root, other.root, ForkDepth());
+    other.root = NULL;
+}
+
+// Keeps every copy of the keys present in both trees and drops the rest,
+// the copies from other are dropped. other is emptied.
+void CartTree::Intersect(CartTree &other) {
+    if (&other == this) return;
+    root = Intersect(root, other.root, ForkDepth());
+    other.root = NULL;
+}
+
+// Removes every copy of the keys present in other, other is emptied.
+void CartTree::Difference(CartTree &other) {
+    if (&other == this) {
+        FreeSubtree(root);
+        root = NULL;
+        return;
+    }
+    root = Difference(root, other.root, ForkDepth());
+    other.root = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Path-copying version of CartTree: nodes are never modified after they are
+// published, so a reader holding a Snapshot can query it while the (single)
+// writer keeps inserting and deleting. Unreachable versions are reclaimed by
+// the shared_ptr reference counts.
+struct PersistentNode;
+typedef std::shared_ptr<const PersistentNode> PersistentLink;
+
+struct PersistentNode {
+    int key;
+    int priority;
+    int rank;
+    PersistentLink left_child;
+    PersistentLink right_child;
+    PersistentNode(int key_, int priority_, const PersistentLink &lc,
+        const PersistentLink &rc): key(key_), priority(priority_), rank(1),
+        left_child(lc), right_child(rc) {
+        if (lc) rank += lc->rank;
+        if (rc) rank += rc->rank;
+    }
+};
+
+class PersistentCartTree {
+    private:
+    PersistentLink root;
+
+    static bool gt(int x, int y, bool eq);
+    static PersistentLink Copy(const PersistentNode *node,
+        const PersistentLink &lc, const PersistentLink &rc);
+    static void Split(const PersistentLink &tree, int key, bool to_right,
+        PersistentLink &left, PersistentLink &right);
+    static PersistentLink Merge(const PersistentLink &left,
+        const PersistentLink &right);
+    void Publish(const PersistentLink &new_root);
+
+    public:
+    class Snapshot {
+        private:
+        PersistentLink root;
+
+        public:
+        explicit Snapshot(const PersistentLink &root_): root(root_) {}
+        const PersistentNode *GetByOrder(int order) const;
+        int Size() const;
+    };
+
+    void Insert(int key);
+    void Delete(int key);
+    const PersistentNode *GetByOrder(int order) const;
+    Snapshot Pin() const;
+    PersistentCartTree();
+    PersistentCartTree(const PersistentCartTree &source) = delete;
+    PersistentCartTree(PersistentCartTree &&source) = delete;
+    PersistentCartTree& operator=(const PersistentCartTree &source) = delete;
+    PersistentCartTree& operator=(PersistentCartTree &&source) = delete;
+};
+
+PersistentCartTree::PersistentCartTree() {
+    srand(time(0));
+}
+
+bool PersistentCartTree::gt(int x, int y, bool eq) {
+    return !eq ? x > y : x >= y;
+}
+
+PersistentLink PersistentCartTree::Copy(const PersistentNode *node,
+    const PersistentLink &lc, const PersistentLink &rc) {
+    return std::make_shared<const PersistentNode>(
+        node->key, node->priority, lc, rc);
+}
+
+// Keys that are gt(key, to_right) go to the right part, the rest to the left
+// one. Only the nodes on the search path are copied.
+void PersistentCartTree::Split(const PersistentLink &tree, int key,
+    bool to_right, PersistentLink &left, PersistentLink &right) {
+    if (!tree) {
+        left.reset();
+        right.reset();
+        return;
+    }
+    PersistentLink sub_left, sub_right;
+    if (gt(tree->key, key, to_right)) {
+        Split(tree->left_child, key, to_right, sub_left, sub_right);
+        right = Copy(tree.get(), sub_right, tree->right_child);
+        left = sub_left;
+    } else {
+        Split(tree->right_child, key, to_right, sub_left, sub_right);
+        left = Copy(tree.get(), tree->left_child, sub_left);
+        right = sub_right;
+    }
+}
+
+// Assume that all keys in left are not greater than keys in right
+PersistentLink PersistentCartTree::Merge(const PersistentLink &left,
+    const PersistentLink &right) {
+    if (!left) return right;
+    if (!right) return left;
+    if (left->priority > right->priority) {
+        return Copy(left.get(), left->left_child,
+            Merge(left->right_child, right));
+    }
+    return Copy(right.get(), Merge(left, right->left_child),
+        right->right_child);
+}
+
+void PersistentCartTree::Publish(const PersistentLink &new_root) {
+    std::atomic_store(&root, new_root);
+}
+
+void PersistentCartTree::Insert(int key) {
+    PersistentLink new_node = std::make_shared<const PersistentNode>(
+        key, rand(), PersistentLink(), PersistentLink());
+    PersistentLink left, right;
+    Split(root, key, false, left, right);
+    Publish(Merge(Merge(left, new_node), right));
+}
+
+void PersistentCartTree::Delete(int key) {
+    PersistentLink left, right, less, equal;
+    Split(root, key, false, left, right);
+    Split(left, key, true, less, equal);
+    if (!equal) return;
+    equal = Merge(equal->left_child, equal->right_child);
+    Publish(Merge(Merge(less, equal), right));
+}
+
+// Only the writer may use the returned pointer without pinning a snapshot.
+const PersistentNode *PersistentCartTree::GetByOrder(int order) const {
+    return Snapshot(root).GetByOrder(order);
+}
+
+PersistentCartTree::Snapshot PersistentCartTree::Pin() const {
+    return Snapshot(std::atomic_load(&root));
+}
+
+const PersistentNode *PersistentCartTree::Snapshot::GetByOrder(
+    int order) const {
+    if (order < 0 || order >= Size()) return NULL;
+    const PersistentNode *current = root.get();
+    while (current) {
+        int left_rank = current->left_child ? current->left_child->rank : 0;
+        if (order == left_rank) return current;
+        if (order < left_rank) {
+            current = current->left_child.get();
+        } else {
+            order -= left_rank + 1;
+            current = current->right_child.get();
+        }
+    }
+    throw std::logic_error(
+        "Can't find element with valid order, snapshot is corrupt!");
+}
+
+int PersistentCartTree::Snapshot::Size() const {
+    return root ? root->rank : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct BPlusKey {
+    int key;
+};
+
+// Number of keys among the first n that are less than (or not greater than,
+// if eq) the given one.
+inline int CountBelow(const BPlusKey *keys, int n, int key, bool eq) {
+    int count = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i pivot = _mm_set1_epi32(key);
+    int above = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(keys + i));
+        __m128i mask = eq ? _mm_cmpgt_epi32(block, pivot)
+                          : _mm_cmpgt_epi32(pivot, block);
+        above += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(mask)));
+    }
+    count = eq ? i - above : above;
+#endif
+    for (; i < n; i++) count += eq ? keys[i].key <= key : keys[i].key < key;
+    return count;
+}
+
+// Order-statistic B+tree with the same interface as CartTree. Inner nodes keep
+// separators and subtree sizes in flat arrays, so a query touches one cache
+// friendly node per level instead of a chain of treap nodes.
+template <int Fanout = 32>
+class BPlusTree {
+    private:
+    static_assert(Fanout >= 4, "B+tree fanout is too small");
+    static const int kMinSize = (Fanout - 1) / 2;
+
+    struct Header {
+        int size;
+        bool leaf;
+    };
+    struct Leaf: Header {
+        alignas(64) BPlusKey keys[Fanout];
+    };
+    // keys[i] separates children[i - 1] and children[i], keys[0] is unused
+    struct Inner: Header {
+        alignas(64) BPlusKey keys[Fanout];
+        alignas(64) int counts[Fanout];
+        Header *children[Fanout];
+    };
+
+    Header *root;
+    int n_keys;
+
+    static Leaf *AsLeaf(Header *node) { return static_cast<Leaf*>(node); }
+    static Inner *AsInner(Header *node) { return static_cast<Inner*>(node); }
+    static Leaf *NewLeaf();
+    static Inner *NewInner();
+    static void FreeNode(Header *node);
+    static void InsertInto(Header *node, int key);
+    static bool DeleteFrom(Header *node, int key);
+    static void SplitChild(Inner *parent, int i);
+    static void Rebalance(Inner *parent, int i);
+    static void BorrowFromLeft(Inner *parent, int i);
+    static void BorrowFromRight(Inner *parent, int i);
+    static void MergeChildren(Inner *parent, int i);
+
+    public:
+    void Insert(int key);
+    void Delete(int key);
+    const BPlusKey *GetByOrder(int order) const;
+    BPlusTree();
+    ~BPlusTree();
+    BPlusTree(const BPlusTree &source) = delete;
+    BPlusTree(BPlusTree &&source) = delete;
+    BPlusTree& operator=(const BPlusTree &source) = delete;
+    BPlusTree& operator=(BPlusTree &&source) = delete;
+};
+
+template <int Fanout>
+BPlusTree<Fanout>::BPlusTree() {
+    root = NewLeaf();
+    n_keys = 0;
+}
+
+template <int Fanout>
+BPlusTree<Fanout>::~BPlusTree() {
+    Deque<Header*> stack;
+    stack.push_back(root);
+    while (stack.len() > 0) {
+        Header *current = stack.pop_back();
+        if (!current->leaf) {
+            Inner *inner = AsInner(current);
+            for (int i = 0; i < inner->size; i++) {
+                stack.push_back(inner->children[i]);
+            }
+        }
+        FreeNode(current);
+    }
+}
+
+template <int Fanout>
+typename BPlusTree<Fanout>::Leaf *BPlusTree<Fanout>::NewLeaf() {
+    Leaf *leaf = new Leaf;
+    leaf->size = 0;
+    leaf->leaf = true;
+    return leaf;
+}
+
+template <int Fanout>
+typename BPlusTree<Fanout>::Inner *BPlusTree<Fanout>::NewInner() {
+    Inner *inner = new Inner;
+    inner->size = 0;
+    inner->leaf = false;
+    return inner;
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::FreeNode(Header *node) {
+    if (node->leaf) {
+        delete AsLeaf(node);
+    } else {
+        delete AsInner(node);
+    }
+}
+
+// Nodes are allowed to fill up to Fanout entries here, the caller splits them.
+template <int Fanout>
+void BPlusTree<Fanout>::InsertInto(Header *node, int key) {
+    if (node->leaf) {
+        Leaf *leaf = AsLeaf(node);
+        int pos = CountBelow(leaf->keys, leaf->size, key, true);
+        memmove(leaf->keys + pos + 1, leaf->keys + pos,
+            (leaf->size - pos)*sizeof(BPlusKey));
+        leaf->keys[pos].key = key;
+        leaf->size++;
+        return;
+    }
+    Inner *inner = AsInner(node);
+    int i = CountBelow(inner->keys + 1, inner->size - 1, key, true);
+    InsertInto(inner->children[i], key);
+    inner->counts[i]++;
+    if (inner->children[i]->size == Fanout) SplitChild(inner, i);
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::SplitChild(Inner *parent, int i) {
+    Header *child = parent->children[i];
+    const int half = Fanout / 2;
+    Header *sibling;
+    int separator;
+    int moved;
+    if (child->leaf) {
+        Leaf *left = AsLeaf(child);
+        Leaf *right = NewLeaf();
+        right->size = Fanout - half;
+        memcpy(right->keys, left->keys + half, right->size*sizeof(BPlusKey));
+        left->size = half;
+        separator = right->keys[0].key;
+        moved = right->size;
+        sibling = right;
+    } else {
+        Inner *left = AsInner(child);
+        Inner *right = NewInner();
+        right->size = Fanout - half;
+        memcpy(right->keys + 1, left->keys + half + 1,
+            (right->size - 1)*sizeof(BPlusKey));
+        memcpy(right->counts, left->counts + half, right->size*sizeof(int));
+        memcpy(right->children, left->children + half,
+            right->size*sizeof(Header*));
+        left->size = half;
+        separator = left->keys[half].key;
+        moved = 0;
+        for (int j = 0; j < right->size; j++) moved += right->counts[j];
+        sibling = right;
+    }
+    const int tail = parent->size - i - 1;
+    memmove(parent->keys + i + 2, parent->keys + i + 1, tail*sizeof(BPlusKey));
+    memmove(parent->counts + i + 2, parent->counts + i + 1, tail*sizeof(int));
+    memmove(parent->children + i + 2, parent->children + i + 1,
+        tail*sizeof(Header*));
+    parent->keys[i + 1].key = separator;
+    parent->children[i + 1] = sibling;
+    parent->counts[i + 1] = moved;
+    parent->counts[i] -= moved;
+    parent->size++;
+}
+
+template <int Fanout>
+bool BPlusTree<Fanout>::DeleteFrom(Header *node, int key) {
+    if (node->leaf) {
+        Leaf *leaf = AsLeaf(node);
+        int pos = CountBelow(leaf->keys, leaf->size, key, false);
+        if (pos == leaf->size || leaf->keys[pos].key != key) return false;
+        memmove(leaf->keys + pos, leaf->keys + pos + 1,
+            (leaf->size - pos - 1)*sizeof(BPlusKey));
+        leaf->size--;
+        return true;
+    }
+    Inner *inner = AsInner(node);
+    // Equal keys may end up on both sides of a separator
+    for (int i = CountBelow(inner->keys + 1, inner->size - 1, key, false);
+        i < inner->size; i++) {
+        if (DeleteFrom(inner->children[i], key)) {
+            inner->counts[i]--;
+            if (inner->children[i]->size < kMinSize) Rebalance(inner, i);
+            return true;
+        }
+        if (i + 1 == inner->size || inner->keys[i + 1].key != key) break;
+    }
+    return false;
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::Rebalance(Inner *parent, int i) {
+    if (i > 0 && parent->children[i - 1]->size > kMinSize) {
+        BorrowFromLeft(parent, i);
+    } else if (i + 1 < parent->size
+        && parent->children[i + 1]->size > kMinSize) {
+        BorrowFromRight(parent, i);
+    } else if (i > 0) {
+        MergeChildren(parent, i - 1);
+    } else if (i + 1 < parent->size) {
+        MergeChildren(parent, i);
+    }
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::BorrowFromLeft(Inner *parent, int i) {
+    int moved = 1;
+    if (parent->children[i]->leaf) {
+        Leaf *left = AsLeaf(parent->children[i - 1]);
+        Leaf *child = AsLeaf(parent->children[i]);
+        memmove(child->keys + 1, child->keys, child->size*sizeof(BPlusKey));
+        child->keys[0] = left->keys[left->size - 1];
+        parent->keys[i] = child->keys[0];
+        left->size--;
+        child->size++;
+    } else {
+        Inner *left = AsInner(parent->children[i - 1]);
+        Inner *child = AsInner(parent->children[i]);
+        memmove(child->keys + 2, child->keys + 1,
+            (child->size - 1)*sizeof(BPlusKey));
+        memmove(child->counts + 1, child->counts, child->size*sizeof(int));
+        memmove(child->children + 1, child->children,
+            child->size*sizeof(Header*));
+        child->keys[1] = parent->keys[i];
+        child->counts[0] = left->counts[left->size - 1];
+        child->children[0] = left->children[left->size - 1];
+        parent->keys[i] = left->keys[left->size - 1];
+        moved = child->counts[0];
+        left->size--;
+        child->size++;
+    }
+    parent->counts[i - 1] -= moved;
+    parent->counts[i] += moved;
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::BorrowFromRight(Inner *parent, int i) {
+    int moved = 1;
+    if (parent->children[i]->leaf) {
+        Leaf *child = AsLeaf(parent->children[i]);
+        Leaf *right = AsLeaf(parent->children[i + 1]);
+        child->keys[child->size] = right->keys[0];
+        memmove(right->keys, right->keys + 1,
+            (right->size - 1)*sizeof(BPlusKey));
+        parent->keys[i + 1] = right->keys[0];
+        child->size++;
+        right->size--;
+    } else {
+        Inner *child = AsInner(parent->children[i]);
+        Inner *right = AsInner(parent->children[i + 1]);
+        child->keys[child->size] = parent->keys[i + 1];
+        child->counts[child->size] = right->counts[0];
+        child->children[child->size] = right->children[0];
+        parent->keys[i + 1] = right->keys[1];
+        moved = right->counts[0];
+        memmove(right->keys + 1, right->keys + 2,
+            (right->size - 2)*sizeof(BPlusKey));
+        memmove(right->counts, right->counts + 1,
+            (right->size - 1)*sizeof(int));
+        memmove(right->children, right->children + 1,
+            (right->size - 1)*sizeof(Header*));
+        child->size++;
+        right->size--;
+    }
+    parent->counts[i] += moved;
+    parent->counts[i + 1] -= moved;
+}
+
+// Appends children[i + 1] to children[i] and drops it from the parent.
+template <int Fanout>
+void BPlusTree<Fanout>::MergeChildren(Inner *parent, int i) {
+    Header *right_node = parent->children[i + 1];
+    if (right_node->leaf) {
+        Leaf *child = AsLeaf(parent->children[i]);
+        Leaf *right = AsLeaf(right_node);
+        memcpy(child->keys + child->size, right->keys,
+            right->size*sizeof(BPlusKey));
+        child->size += right->size;
+    } else {
+        Inner *child = AsInner(parent->children[i]);
+        Inner *right = AsInner(right_node);
+        child->keys[child->size] = parent->keys[i + 1];
+        memcpy(child->keys + child->size + 1, right->keys + 1,
+            (right->size - 1)*sizeof(BPlusKey));
+        memcpy(child->counts + child->size, right->counts,
+            right->size*sizeof(int));
+        memcpy(child->children + child->size, right->children,
+            right->size*sizeof(Header*));
+        child->size += right->size;
+    }
+    parent->counts[i] += parent->counts[i + 1];
+    const int tail = parent->size - i - 2;
+    memmove(parent->keys + i + 1, parent->keys + i + 2, tail*sizeof(BPlusKey));
+    memmove(parent->counts + i + 1, parent->counts + i + 2, tail*sizeof(int));
+    memmove(parent->children + i + 1, parent->children + i + 2,
+        tail*sizeof(Header*));
+    parent->size--;
+    FreeNode(right_node);
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::Insert(int key) {
+    InsertInto(root, key);
+    n_keys++;
+    if (root->size < Fanout) return;
+    Inner *new_root = NewInner();
+    new_root->size = 1;
+    new_root->children[0] = root;
+    new_root->counts[0] = n_keys;
+    root = new_root;
+    SplitChild(new_root, 0);
+}
+
+template <int Fanout>
+void BPlusTree<Fanout>::Delete(int key) {
+    if (!DeleteFrom(root, key)) return;
+    n_keys--;
+    if (!root->leaf && root->size == 1) {
+        Header *old_root = root;
+        root = AsInner(root)->children[0];
+        FreeNode(old_root);
+    }
+}
+
+template <int Fanout>
+const BPlusKey *BPlusTree<Fanout>::GetByOrder(int order) const {
+    if (order < 0 || order >= n_keys) return NULL;
+    Header *current = root;
+    while (!current->leaf) {
+        Inner *inner = AsInner(current);
+        int i = 0;
+        while (order >= inner->counts[i]) {
+            order -= inner->counts[i];
+            i++;
+        }
+        current = inner->children[i];
+    }
+    return AsLeaf(current)->keys + order;
+}
+
+template <typename Tree = CartTree>
 void order_statistics(int *commands, int n_commands) {
-    CartTree tree;
+    Tree tree;
     for (int i = 0; i < n_commands; i++) {
         int key = commands[2*i];
         int order = commands[2*i + 1];